@@ -0,0 +1,176 @@
+/**
+ * @file arena.cpp
+ * @author Marco Costa
+ * @brief Preallocated frontier storage shared by the workers, carved in cache aligned blocks
+ * @version 0.1
+ * @date 2021-09-08
+ */
+#ifndef ARENA_CPP
+#define ARENA_CPP
+
+#include <atomic>
+#include <vector>
+#include <cstdlib>
+#include <cstdio>
+#include <cstddef>
+#include <algorithm>
+
+#include "config.hpp"
+
+/**
+ * @brief The frontier of one level, written by the workers without any allocation. The
+ *        storage is allocated once for `capacity` nodes plus one spare block per worker:
+ *        a worker appends to its own block and takes the next free block when it is full,
+ *        with one atomic increment per block. Since a node is claimed by one worker only,
+ *        a frontier never holds more than `capacity` nodes, so the blocks never run out.
+ *        The per worker cursors are on separate cache lines.
+ *        After `seal` the frontier is the sequence of the first `n_blocks()` blocks,
+ *        indexed as a whole through `block_offsets`.
+ */
+class FrontierArena
+{
+public:
+    FrontierArena(size_t capacity, int n_workers, size_t block_size = default_arena_block)
+        : block_size(block_size),
+          max_blocks((capacity + block_size - 1) / block_size + n_workers),
+          cursors(n_workers),
+          block_fill(max_blocks),
+          offsets(max_blocks + 1)
+    {
+        /* the blocks are 64-byte aligned as long as `block_size` ints are a multiple of 64 bytes */
+        storage = (int *)aligned_alloc(64, align_size(max_blocks * block_size * sizeof(int)));
+        if (storage == NULL)
+        {
+            perror("FrontierArena");
+            exit(-1);
+        }
+    }
+
+    ~FrontierArena()
+    {
+        free(storage);
+    }
+
+    FrontierArena(const FrontierArena &) = delete;
+    FrontierArena &operator=(const FrontierArena &) = delete;
+
+    /**
+     * @brief Appends `node` to the part of the frontier of the worker `thread_no`
+     */
+    inline void push(int thread_no, int node)
+    {
+        cursor &c = cursors[thread_no];
+        if (c.pos == c.end)
+            next_block(c);
+        *c.pos++ = node;
+    }
+
+    /**
+     * @brief Closes the frontier once the workers are done with it, called by the master
+     *
+     * @return size_t the number of nodes in the frontier
+     */
+    size_t seal()
+    {
+        for (auto &c : cursors)
+            if (c.block != no_block)
+                block_fill[c.block] = c.pos - block_start(c.block);
+
+        sealed_blocks = std::min(next_free.load(std::memory_order_relaxed), max_blocks);
+        for (size_t b = 0; b < sealed_blocks; b++)
+            offsets[b + 1] = offsets[b] + block_fill[b];
+        return offsets[sealed_blocks];
+    }
+
+    /**
+     * @brief Empties the frontier, keeping the storage, called by the master
+     */
+    void reset()
+    {
+        for (auto &c : cursors)
+        {
+            c.pos = c.end = NULL;
+            c.block = no_block;
+        }
+        next_free.store(0, std::memory_order_relaxed);
+        sealed_blocks = 0;
+    }
+
+    inline size_t size() const { return offsets[sealed_blocks]; }
+    inline size_t n_blocks() const { return sealed_blocks; }
+    inline const int *block_start(size_t b) const { return storage + b * block_size; }
+    inline const size_t *block_offsets() const { return offsets.data(); }
+
+    /**
+     * @brief The `j`-th node of the sealed frontier, `b` is the block of the previous access
+     *        (0 at first), for a scan in increasing `j`
+     */
+    inline int at(size_t j, size_t &b) const
+    {
+        while (offsets[b + 1] <= j)
+            b++;
+        return storage[b * block_size + (j - offsets[b])];
+    }
+
+    /**
+     * @brief The `j`-th node of the sealed frontier, in any order
+     */
+    inline int at(size_t j) const
+    {
+        size_t b = std::upper_bound(offsets.begin(), offsets.begin() + sealed_blocks + 1, j) - offsets.begin() - 1;
+        return storage[b * block_size + (j - offsets[b])];
+    }
+
+    /**
+     * @brief Copies the sealed frontier to `out`, which must have room for `size()` nodes
+     */
+    void copy_to(int *out) const
+    {
+        for (size_t b = 0; b < sealed_blocks; b++)
+            std::copy(block_start(b), block_start(b) + block_fill[b], out + offsets[b]);
+    }
+
+private:
+    static constexpr size_t no_block = (size_t)-1;
+
+    struct alignas(64) cursor
+    {
+        int *pos = NULL;
+        int *end = NULL;
+        size_t block = no_block;
+    };
+
+    size_t block_size;
+    size_t max_blocks;
+    int *storage;
+    std::vector<cursor> cursors;
+    std::atomic<size_t> next_free{0};
+    std::vector<size_t> block_fill;
+    std::vector<size_t> offsets; /* prefix sum of the fills of the sealed blocks */
+    size_t sealed_blocks = 0;
+
+    static size_t align_size(size_t size)
+    {
+        return (size + 63) / 64 * 64 + 64; /* aligned_alloc wants a multiple of the alignment, never 0 */
+    }
+
+    inline int *block_start(size_t b) { return storage + b * block_size; }
+
+    void next_block(cursor &c)
+    {
+        if (c.block != no_block)
+            block_fill[c.block] = block_size;
+
+        size_t b = next_free.fetch_add(1, std::memory_order_relaxed);
+        if (b >= max_blocks)
+        {
+            fprintf(stderr, "FrontierArena: out of blocks, a node was pushed twice\n");
+            abort();
+        }
+        c.block = b;
+        c.pos = block_start(b);
+        c.end = c.pos + block_size;
+    }
+};
+
+#endif
@@ -0,0 +1,93 @@
+/**
+ * @file balance.cpp
+ * @author Marco Costa
+ * @brief The degree-aware partition of a frontier in parts of equal edges
+ * @version 0.1
+ * @date 2021-09-08
+ */
+#ifndef BALANCE_CPP
+#define BALANCE_CPP
+
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+
+#include "prefetch.cpp"
+
+/**
+ * @brief The work of a frontier in units: the entry j is worth `degree + 1` units, its node
+ *        then each of its edges, and `prefix` sums them over the entries. The part p of n is
+ *        the units [total * p / n, total * (p + 1) / n), so the parts have the same edges up
+ *        to one unit however the degrees are skewed (the first nodes of `generate_graph` have
+ *        most of the edges). A part boundary inside an adjacency splits the hub among the
+ *        workers, on the compressed adjacencies, which are decoded in order, it is moved to
+ *        the start of the next node instead.
+ */
+class EdgeBalance
+{
+public:
+    std::vector<size_t> prefix = {0}; /* the units before each entry, n + 1 of them */
+
+    /**
+     * @brief Sums the units of the `n` entries of a frontier, `node(j)` the node of the entry j
+     */
+    template <typename G, typename N>
+    void build(const G *g, size_t n, N node)
+    {
+        prefix.resize(n + 1);
+        prefix[0] = 0;
+        for (size_t j = 0; j < n; j++)
+            prefix[j + 1] = prefix[j] + g->get_degree(node(j)) + 1;
+    }
+
+    inline size_t total() const { return prefix.back(); }
+
+    /**
+     * @brief Calls `visit_node(node)` on the nodes and `visit_edge(val)` on the neighbors in
+     *        the part `part` of `n_parts` of the frontier, `node(j)` as in `build`
+     *
+     * @tparam V void(uint), counts a node, called on the part holding its first unit only
+     * @tparam E void(uint), claims a neighbor
+     */
+    template <typename G, typename N, typename V, typename E>
+    inline void for_each_in_part(const G *g, N node, int part, int n_parts, V visit_node, E visit_edge) const
+    {
+        using A = typename std::decay<decltype(g->get_adj(0))>::type;
+        constexpr bool split = random_access_adj<A>();
+
+        size_t n = prefix.size() - 1;
+        size_t lo = total() * part / n_parts, hi = total() * (part + 1) / n_parts;
+        if (lo >= hi)
+            return;
+
+        size_t j = std::upper_bound(prefix.begin(), prefix.end(), lo) - prefix.begin() - 1;
+        if (!split && prefix[j] < lo)
+            j++; /* the node started in the previous part is all there */
+
+        for (; j < n && prefix[j] < hi; j++)
+        {
+            uint curr_node = node(j);
+            size_t u_first = std::max(lo, prefix[j]);
+            if (u_first == prefix[j])
+                visit_node(curr_node);
+
+            const auto &adj = g->get_adj(curr_node);
+            if constexpr (split)
+            {
+                /* the units past the node are its edges, in adjacency order */
+                auto first = adj.begin();
+                size_t e_first = (u_first > prefix[j]) ? u_first - prefix[j] - 1 : 0;
+                size_t e_last = std::min(hi, prefix[j + 1]) - prefix[j] - 1;
+                for (size_t k = e_first; k < e_last; k++)
+                    visit_edge(first[k]);
+            }
+            else
+            {
+                for (auto &val : adj)
+                    visit_edge(val);
+            }
+        }
+    }
+};
+
+#endif
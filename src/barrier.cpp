@@ -0,0 +1,202 @@
+/**
+ * @file barrier.cpp
+ * @author Marco Costa
+ * @brief The master/workers barriers synchronizing the levels of the parallel BFS
+ * @version 0.1
+ * @date 2021-09-08
+ */
+#ifndef BARRIER_CPP
+#define BARRIER_CPP
+
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <cstddef>
+
+#include "config.hpp"
+
+/**
+ * @brief Class which implements a multiple workers with multiple generations barrier
+ */
+class Barrier
+{
+public:
+    explicit Barrier(std::size_t i_count) : m_threshold(i_count),
+                                           m_count(i_count),
+                                           m_generation(0)
+    {
+    }
+
+    /**
+     * @brief Puts the master on wait, waiting to be woken up by the workers
+     */
+    void MasterWait()
+    {
+        std::unique_lock<std::mutex> m_lock{m_mutex};
+        m_cond.wait(m_lock, [this]
+                    { return stop_master; });
+        stop_master = false;
+    }
+
+    /**
+     * @brief Starts the workers which should be on wait
+     */
+    void StartWorkers()
+    {
+        std::unique_lock<std::mutex> w_lock{w_mutex};
+        m_generation++;
+        w_cond.notify_all();
+    }
+
+    /**
+     * @brief Puts a worker on wait, if that worker is the last to be wake it wakes up
+     *        the master thread before putting himself on wait
+     */
+    void WorkerWait()
+    {
+        std::unique_lock<std::mutex> w_lock{w_mutex};
+        auto l_gen = m_generation;
+        if (!--m_count)
+        {
+            m_count = m_threshold;
+            {
+                /* under the master mutex, otherwise the wakeup may be lost */
+                std::lock_guard<std::mutex> m_lock{m_mutex};
+                stop_master = true;
+            }
+            m_cond.notify_one();
+        }
+        w_cond.wait(w_lock, [this, l_gen]
+                    { return l_gen != m_generation; }); /* needed to avoid spurious wakeups */ 
+    }
+
+private:
+    std::mutex w_mutex; /* the workers mutex */
+    std::mutex m_mutex; /* the master mutex */
+    std::condition_variable w_cond; /* the workers condition variable */
+    std::condition_variable m_cond; /* the master condition variable */
+    std::size_t m_threshold; /* the total number of workers */
+    std::size_t m_count; /* the current number of workers not in wait */
+    std::size_t m_generation; /* the current generation */
+    bool stop_master = false;
+};
+
+/**
+ * @brief Hint to the CPU that the thread is spinning
+ */
+inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+/**
+ * @brief Same interface of `Barrier`, but both the worker barrier (sense reversing) and the
+ *        master/workers handoff are lock free. A waiting thread spins with exponential
+ *        backoff (then yielding) for up to `spin_budget` pauses and only then sleeps on a condition
+ *        variable, so short levels never pay the futex sleep/wake round trip.
+ */
+class SpinBarrier
+{
+public:
+    static inline std::size_t default_budget = default_spin_budget; /* spin budget of the new barriers */
+
+    explicit SpinBarrier(std::size_t i_count, std::size_t spin_budget = default_budget) : m_threshold(i_count),
+                                                                                       m_count(i_count),
+                                                                                       m_budget(spin_budget)
+    {
+    }
+
+    /**
+     * @brief Puts the master on wait, until the last worker has arrived
+     */
+    void MasterWait()
+    {
+        Wait([this]
+             { return master_go.load(); });
+        master_go.store(false, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Starts the workers which should be on wait, reversing the sense
+     */
+    void StartWorkers()
+    {
+        m_sense.store(!m_sense.load(std::memory_order_relaxed));
+        Wake();
+    }
+
+    /**
+     * @brief Puts a worker on wait, the last one to arrive releases the master
+     */
+    void WorkerWait()
+    {
+        bool l_sense = m_sense.load(std::memory_order_relaxed); /* cannot change before we arrive */
+        if (m_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            m_count.store(m_threshold, std::memory_order_relaxed);
+            master_go.store(true);
+            Wake();
+        }
+        Wait([this, l_sense]
+             { return m_sense.load() != l_sense; });
+    }
+
+private:
+    /**
+     * @brief Spins with exponential backoff until `ready`, then falls back to sleeping.
+     *        `ready` and `sleepers` are sequentially consistent: either the waker sees
+     *        the sleeper or the sleeper sees the condition, so no wakeup is lost.
+     */
+    template <typename P>
+    void Wait(P ready)
+    {
+        for (std::size_t spins = 0, backoff = 1; spins < m_budget; spins += backoff)
+        {
+            if (ready())
+                return;
+            if (backoff < max_backoff)
+            {
+                for (std::size_t i = 0; i < backoff; i++)
+                    cpu_relax();
+                backoff *= 2;
+            }
+            else
+                std::this_thread::yield(); /* long wait, maybe more threads than cores */
+        }
+
+        std::unique_lock<std::mutex> s_lock{s_mutex};
+        sleepers++;
+        s_cond.wait(s_lock, ready);
+        sleepers--;
+    }
+
+    void Wake()
+    {
+        if (sleepers.load() > 0)
+        {
+            {
+                std::lock_guard<std::mutex> s_lock{s_mutex};
+            }
+            s_cond.notify_all();
+        }
+    }
+
+    const static std::size_t max_backoff = 1024; /* the longest pause sequence between two checks */
+
+    std::size_t m_threshold; /* the total number of workers */
+    alignas(64) std::atomic<std::size_t> m_count; /* the current number of workers not in wait */
+    alignas(64) std::atomic<bool> m_sense{false}; /* flipped at every generation */
+    alignas(64) std::atomic<bool> master_go{false}; /* set by the last worker arriving */
+    std::atomic<int> sleepers{0}; /* threads (master or workers) sleeping on `s_cond` */
+    std::size_t m_budget; /* the pauses spent spinning before sleeping */
+    std::mutex s_mutex;
+    std::condition_variable s_cond;
+};
+
+#endif
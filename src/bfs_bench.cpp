@@ -0,0 +1,648 @@
+/**
+ * @file bfs_bench.cpp
+ * @author Marco Costa
+ * @brief Benchmark driver running every BFS engine over sweeps of graphs and parameters
+ * @version 0.1
+ * @date 2021-09-08
+ */
+#define TEST_CPP /* excludes the main of the engines */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <map>
+
+#include "bfs_seq.cpp"
+#include "bfs_thread.cpp"
+#ifndef NO_FASTFLOW
+#include "bfs_ff.cpp"
+#endif
+#include "utimer.cpp"
+#include "utils.cpp"
+#include "query.cpp"
+#include "config.hpp"
+
+/**
+ * @brief The result of the repetitions of one engine on one configuration
+ */
+struct BenchResult
+{
+    string engine;
+    uint n_nodes;
+    int percent;
+    int seed;  /* of the generated graph, -1 for a graph from file */
+    int start; /* the original id of the start node */
+    int threads;
+    int chunk; /* 0 when the engine has no chunk size */
+    int reps;
+    double median_us;
+    double p95_us;
+    double speedup; /* on the median of the sequential BFS on the same graph */
+    double efficiency;
+    double mteps; /* millions of edges per second, on the median and on the edges the sequential BFS scans for the query */
+    int occurrences;
+    bool ok; /* same occurrences of the sequential BFS */
+
+    /* the configuration, which identifies the result in a baseline */
+    string key() const
+    {
+        return engine + "," + to_string(n_nodes) + "," + to_string(percent) + "," + to_string(seed) + "," +
+               to_string(start) + "," + to_string(threads) + "," + to_string(chunk);
+    }
+};
+
+/**
+ * @brief The engines known by the benchmark, the chunked ones are swept over `--chunks`
+ */
+const static vector<string> all_engines = {"seq", "rr", "rr-edges", "static", "nomerge", "bitmap", "steal", "async", "hybrid", "engine",
+                                           "spin", "numa", "policy", "index"
+#ifndef NO_FASTFLOW
+                                           ,
+                                           "ff", "ff-edges", "ff-nomerge", "ff-bitmap", "ff-engine"
+#endif
+};
+
+bool is_chunked(const string &engine)
+{
+    return engine == "rr" || engine == "nomerge" || engine == "bitmap" || engine == "engine" || engine == "spin" ||
+           engine == "numa" || engine == "policy" || engine == "ff" || engine == "ff-nomerge" || engine == "ff-bitmap" || engine == "ff-engine";
+}
+
+/* the engines which stop on a bounded `BfsQuery` */
+bool supports_query(const string &engine)
+{
+    return engine == "seq" || engine == "rr" || engine == "rr-edges" || engine == "spin" || engine == "ff" || engine == "ff-edges";
+}
+
+/**
+ * @brief Prepares one search of `engine`: the returned function performs the search only,
+ *        everything the engine keeps across searches (threads, buffers) is set up here
+ *
+ * @return function<int()> the search, empty if the engine is unknown
+ */
+template <typename G>
+function<int()> make_search(const string &engine, G *g, const CSRGraph *rg, int start_node, int search_value,
+                            int threads, int chunk, const BfsQuery &query = BfsQuery())
+{
+    if (engine == "seq")
+        return [=]()
+        { return sequential_bfs(g, start_node, search_value, query); };
+    /* the cutoff of the engines started by each search is calibrated here, on this graph */
+    if (engine == "rr" || engine == "rr-edges")
+    {
+        long cutoff = parallel_bfs_cutoff(g, threads);
+        return [=]()
+        { return dispatch_parallel_bfs(g, start_node, search_value, threads, chunk, query, cutoff, engine == "rr-edges"); };
+    }
+    if (engine == "spin")
+    {
+        long cutoff = parallel_bfs_cutoff<SpinBarrier>(g, threads);
+        return [=]()
+        { return dispatch_parallel_bfs<SpinBarrier>(g, start_node, search_value, threads, chunk, query, cutoff); };
+    }
+    if (engine == "static")
+        return [=]()
+        { return __parallel_bfs_static(g, start_node, search_value, threads); };
+    if (engine == "nomerge" || engine == "bitmap")
+        return [=]()
+        { return parallel_bfs_nomerge(g, start_node, search_value, threads, engine == "bitmap", chunk); };
+    if (engine == "steal")
+        return [=]()
+        { return parallel_bfs_steal(g, start_node, search_value, threads); };
+    if (engine == "async")
+        return [=]()
+        { return async_bfs(g, start_node, search_value, threads); };
+    if (engine == "hybrid")
+        return [=]()
+        { return hybrid_bfs(g, rg, start_node, search_value, threads); };
+    if (engine == "engine")
+    {
+        function<int(int, int)> e = make_policy_engine(g, threads, chunk);
+        return [=]()
+        { return e(start_node, search_value); };
+    }
+    if (engine == "policy")
+    {
+        BfsPolicyConfig config;
+        config.chunk_size = chunk;
+        return [=]()
+        {
+            int occ = -1;
+            return (dispatch_policy_bfs(g, start_node, search_value, threads, config, &occ)) ? occ : -1;
+        };
+    }
+    if (engine == "index")
+    {
+        /* the build is the setup, a search is a lookup (the first one a BFS on a directed graph) */
+        shared_ptr<ValueIndex<G>> index(new ValueIndex<G>(g, threads));
+        return [=]()
+        { return index->count(start_node, search_value); };
+    }
+    if (engine == "numa")
+    {
+        shared_ptr<NumaLayout> layout(new NumaLayout(NumaTopology::detect(), threads, g->n_nodes));
+        shared_ptr<CSRGraph> placed(numa_place(g, *layout));
+        return [=]()
+        { return numa_bfs(placed.get(), *layout, start_node, search_value, true, chunk); };
+    }
+#ifndef NO_FASTFLOW
+    if (engine == "ff" || engine == "ff-edges")
+    {
+        long cutoff = ff_bfs_cutoff(g, threads);
+        return [=]()
+        { return ff_bfs(g, start_node, search_value, threads, chunk, query, cutoff, engine == "ff-edges"); };
+    }
+    if (engine == "ff-nomerge" || engine == "ff-bitmap")
+        return [=]()
+        { return ff_bfs_nomerge(g, start_node, search_value, threads, engine == "ff-bitmap", chunk); };
+    if (engine == "ff-engine")
+    {
+        shared_ptr<FFBfsEngine<G>> e(new FFBfsEngine<G>(g, threads, chunk));
+        return [=]()
+        { return e->run(start_node, search_value); };
+    }
+#endif
+    return function<int()>();
+}
+
+/**
+ * @brief Counts the edges scanned by `sequential_bfs` from `start_node`, i.e. the out-degrees of
+ *        the nodes it expands: all the reached nodes, or with a bounded `query` only those it
+ *        expands before stopping (the MTEPS of a bounded search are on the edges it needs)
+ */
+template <typename G>
+eid_t traversed_edges(G *g, int start_node, int search_value, const BfsQuery &query = BfsQuery())
+{
+    vector<bool> visited(g->n_nodes);
+    vector<int> q = {start_node};
+    vector<int> depth = {0};
+    visited[start_node] = true;
+    eid_t edges = 0;
+    int matches = 0;
+    for (size_t i = 0; i < q.size(); i++)
+    {
+        if (g->get_value(q[i]) == search_value && ++matches == query.max_matches)
+            break;
+        if (!query.expands(depth[i]))
+            continue;
+        edges += g->get_degree(q[i]);
+        for (auto &val : g->get_adj(q[i]))
+        {
+            if (!visited[val])
+            {
+                visited[val] = true;
+                q.push_back(val);
+                depth.push_back(depth[i] + 1);
+            }
+        }
+    }
+    return edges;
+}
+
+/**
+ * @brief Runs `warmup` untimed and `reps` timed searches
+ *
+ * @return vector<double> the sorted times in usec
+ */
+vector<double> time_search(const function<int()> &search, int warmup, int reps, int *occurrences)
+{
+    for (int i = 0; i < warmup; i++)
+        *occurrences = search();
+
+    vector<double> times;
+    for (int i = 0; i < reps; i++)
+    {
+        START(t);
+        *occurrences = search();
+        STOP(t, elapsed);
+        times.push_back(elapsed);
+    }
+    sort(times.begin(), times.end());
+    return times;
+}
+
+double median(const vector<double> &sorted)
+{
+    size_t n = sorted.size();
+    return (n % 2) ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+}
+
+/* nearest rank percentile */
+double percentile(const vector<double> &sorted, double p)
+{
+    size_t rank = (size_t)ceil(p * sorted.size());
+    return sorted[max<size_t>(rank, 1) - 1];
+}
+
+/**
+ * @brief Runs every engine on the graph `g` from the start node `orig_start` (an original id)
+ */
+template <typename G>
+void bench_start(G *g, const CSRGraph *rg, int percent, int seed, const vector<string> &engines, const vector<int> &threads,
+                 const vector<int> &chunks, int orig_start, int search_value, const BfsQuery &query, int warmup,
+                 int reps, vector<BenchResult> &results)
+{
+    /* the start node is an original id, also on a relabeled graph */
+    int start_node = g->node_id(orig_start);
+    eid_t edges = traversed_edges(g, start_node, search_value, query);
+
+    /* the sequential baseline */
+    int seq_occ;
+    double seq_median = median(time_search(make_search("seq", g, rg, start_node, search_value, 1, 0, query), warmup, reps, &seq_occ));
+
+    for (auto &engine : engines)
+    {
+        for (auto &th : (engine == "seq") ? vector<int>{1} : threads)
+        {
+            for (auto &chunk : is_chunked(engine) ? chunks : vector<int>{0})
+            {
+                auto search = make_search(engine, g, rg, start_node, search_value, th, (chunk > 0) ? chunk : CHUNK_SIZE, query);
+                if (!search)
+                {
+                    fprintf(stderr, "Unknown engine %s\n", engine.c_str());
+                    exit(-1);
+                }
+
+                BenchResult r;
+                r.engine = engine;
+                r.n_nodes = g->n_nodes;
+                r.percent = percent;
+                r.seed = seed;
+                r.start = orig_start;
+                r.threads = th;
+                r.chunk = chunk;
+                r.reps = reps;
+                vector<double> times = time_search(search, warmup, reps, &r.occurrences);
+                r.median_us = median(times);
+                r.p95_us = percentile(times, 0.95);
+                r.speedup = seq_median / max(r.median_us, 1.0);
+                r.efficiency = r.speedup / th;
+                r.mteps = edges / max(r.median_us, 1.0);
+                r.ok = (r.occurrences == seq_occ);
+                results.push_back(r);
+
+                fprintf(stderr, "%s n=%u p=%d seed=%d s=%d t=%d c=%d: %.0f usec%s\n", engine.c_str(), r.n_nodes, percent,
+                        seed, orig_start, th, chunk, r.median_us, (r.ok) ? "" : " WRONG RESULT");
+            }
+        }
+    }
+}
+
+/**
+ * @brief Runs every engine on the graph `g` from each start node over the sweeps of threads
+ *        and chunks, checking the occurrences of every engine against the sequential BFS
+ *        from the same start node
+ */
+template <typename G>
+void bench_graph(G *g, int percent, int seed, const vector<string> &engines, const vector<int> &threads,
+                 const vector<int> &chunks, const vector<int> &start_nodes, int search_value, const BfsQuery &query,
+                 int warmup, int reps, vector<BenchResult> &results)
+{
+    CSRGraph *rg = NULL;
+    if (find(engines.begin(), engines.end(), "hybrid") != engines.end())
+        rg = transpose_graph(g);
+
+    for (auto &orig_start : start_nodes)
+    {
+        if (orig_start < 0 || (uint)orig_start >= g->n_nodes)
+        {
+            fprintf(stderr, "Start node %d skipped on %u nodes\n", orig_start, g->n_nodes);
+            continue;
+        }
+        bench_start(g, rg, percent, seed, engines, threads, chunks, orig_start, search_value, query, warmup, reps, results);
+    }
+
+    delete rg;
+}
+
+void print_csv(ostream &out, const vector<BenchResult> &results)
+{
+    out << "engine,n_nodes,percent,seed,start,threads,chunk,reps,median_us,p95_us,speedup,efficiency,mteps,occurrences,ok" << endl;
+    for (auto &r : results)
+        out << r.engine << "," << r.n_nodes << "," << r.percent << "," << r.seed << "," << r.start << "," << r.threads << "," << r.chunk << ","
+            << r.reps << "," << r.median_us << "," << r.p95_us << "," << r.speedup << "," << r.efficiency << ","
+            << r.mteps << "," << r.occurrences << "," << r.ok << endl;
+}
+
+void print_json(ostream &out, const vector<BenchResult> &results)
+{
+    out << "[" << endl;
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        auto &r = results[i];
+        out << "  {\"engine\": \"" << r.engine << "\", \"n_nodes\": " << r.n_nodes << ", \"percent\": " << r.percent
+            << ", \"seed\": " << r.seed << ", \"start\": " << r.start << ", \"threads\": " << r.threads << ", \"chunk\": " << r.chunk << ", \"reps\": " << r.reps
+            << ", \"median_us\": " << r.median_us << ", \"p95_us\": " << r.p95_us << ", \"speedup\": " << r.speedup
+            << ", \"efficiency\": " << r.efficiency << ", \"mteps\": " << r.mteps
+            << ", \"occurrences\": " << r.occurrences << ", \"ok\": " << (r.ok ? "true" : "false") << "}"
+            << ((i + 1 < results.size()) ? "," : "") << endl;
+    }
+    out << "]" << endl;
+}
+
+/**
+ * @brief Reads the medians of a baseline, a CSV written by `print_csv` on the same graph options,
+ *        by configuration
+ *
+ * @return bool false if the file cannot be read or misses a column
+ */
+bool read_baseline(const string &filename, map<string, double> &medians)
+{
+    ifstream in(filename);
+    string line;
+    if (!in.is_open() || !getline(in, line))
+    {
+        fprintf(stderr, "%s: cannot read the baseline\n", filename.c_str());
+        return false;
+    }
+
+    /* the columns by name, so that a baseline with other columns still matches */
+    auto split = [](const string &l)
+    {
+        vector<string> fields;
+        stringstream ss(l);
+        string f;
+        while (getline(ss, f, ','))
+            fields.push_back(f);
+        return fields;
+    };
+    vector<string> header = split(line);
+    const vector<string> key_columns = {"engine", "n_nodes", "percent", "seed", "start", "threads", "chunk"};
+    vector<size_t> key_index;
+    for (auto &name : key_columns)
+        key_index.push_back(find(header.begin(), header.end(), name) - header.begin());
+    size_t median_index = find(header.begin(), header.end(), "median_us") - header.begin();
+    if (median_index == header.size() ||
+        find(key_index.begin(), key_index.end(), header.size()) != key_index.end())
+    {
+        fprintf(stderr, "%s: not a benchmark CSV with the seed and start columns\n", filename.c_str());
+        return false;
+    }
+
+    while (getline(in, line))
+    {
+        vector<string> fields = split(line);
+        if (fields.size() != header.size())
+            continue;
+        string key;
+        for (size_t k = 0; k < key_index.size(); k++)
+            key += ((k > 0) ? "," : "") + fields[key_index[k]];
+        medians[key] = atof(fields[median_index].c_str());
+    }
+    return true;
+}
+
+/**
+ * @brief Flags the results slower than their baseline median by more than `tolerance` percent;
+ *        the medians under `default_bench_floor_us` in both runs are timer noise and not compared
+ *
+ * @return size_t the number of regressions
+ */
+size_t compare_baseline(const vector<BenchResult> &results, const map<string, double> &medians, double tolerance)
+{
+    size_t regressions = 0, compared = 0;
+    for (auto &r : results)
+    {
+        auto it = medians.find(r.key());
+        if (it == medians.end())
+            continue;
+        compared++;
+        double base = it->second;
+        if (std::max(base, r.median_us) < default_bench_floor_us || r.median_us <= base * (1 + tolerance / 100))
+            continue;
+        regressions++;
+        fprintf(stderr, "SLOWER %s n=%u p=%d seed=%d s=%d t=%d c=%d: %.0f usec, baseline %.0f usec (%+.0f%%)\n",
+                r.engine.c_str(), r.n_nodes, r.percent, r.seed, r.start, r.threads, r.chunk, r.median_us, base,
+                (r.median_us / std::max(base, 1.0) - 1) * 100);
+    }
+    fprintf(stderr, "%zu of %zu results compared with the baseline, %zu slower by more than %.0f%%\n", compared,
+            results.size(), regressions, tolerance);
+    return regressions;
+}
+
+/* a `Graph` copy of g, with every edge also reversed if `undirected` */
+template <typename G>
+Graph *copy_graph(const G *g, bool undirected)
+{
+    Graph *c = new Graph(g->n_nodes);
+    for (uint i = 0; i < g->n_nodes; i++)
+    {
+        c->set_value(i, g->get_value(i));
+        for (auto &val : g->get_adj(i))
+        {
+            c->add_edge(i, val);
+            if (undirected && val != i)
+                c->add_edge(val, i);
+        }
+    }
+    return c;
+}
+
+/**
+ * @brief Checks `ValueIndex` under updates, on a directed and on an undirected copy of `g`:
+ *        random values and edges are set through the index and on a reference copy, whose
+ *        sequential BFS answers the same counts after every batch of updates. The values grow
+ *        past the largest one batch after batch, so the index is invalidated within the batches.
+ *
+ * @return size_t the counts of the index different from the sequential BFS
+ */
+template <typename G>
+size_t verify_index_updates(const G *g, int n_workers, int max_value, int seed)
+{
+    size_t wrong = 0;
+    if (g->n_nodes == 0)
+        return 0;
+
+    for (bool undirected : {false, true})
+    {
+        Graph *indexed = copy_graph(g, undirected);
+        Graph *reference = copy_graph(g, undirected);
+        ValueIndex<Graph> index(indexed, n_workers);
+
+        for (int u = 0; u < default_index_updates; u++)
+        {
+            uint n1 = counter_rand(seed, u, 0) % g->n_nodes;
+            uint n2 = counter_rand(seed, u, 1) % g->n_nodes;
+            int batch = u / default_index_batch;
+            if (counter_rand(seed, u, 2) % 2)
+            {
+                short value = (counter_rand(seed, u, 3) % (max_value + batch + 1)) + 1;
+                index.set_value(n1, value);
+                reference->set_value(n1, value);
+            }
+            else
+            {
+                index.add_edge(n1, n2);
+                reference->add_edge(n1, n2);
+                if (undirected && n1 != n2)
+                    reference->add_edge(n2, n1);
+            }
+
+            if ((u + 1) % default_index_batch != 0)
+                continue;
+            for (int v = 1; v <= max_value + batch + 1; v++)
+            {
+                int occ = index.count(n2, v);
+                int expected = sequential_bfs(reference, n2, v);
+                if (occ != expected)
+                {
+                    wrong++;
+                    fprintf(stderr, "index %s n=%u seed=%d update=%d s=%u v=%d: %d occurrences, expected %d\n",
+                            (undirected) ? "undirected" : "directed", g->n_nodes, seed, u, n2, v, occ, expected);
+                }
+            }
+        }
+        delete indexed;
+        delete reference;
+    }
+    return wrong;
+}
+
+int main(int argc, char *argv[])
+{
+    if (cmdOptionExists(argv, argv + argc, "--help"))
+    {
+        printf("Usage: %s --nodes [n,...] --percent [p,...] --threads [t,...] --chunks [c,...] \
+        --engines [engine,...|all] --reps [reps] --warmup [warmup] --start [start_node,...] \
+        --search [search_value] --max [max_value] --seed [seed_value,...] [--csr] [--pgen n_threads] \
+        [--compress] [--graph graph_file] [--edges edge_list] [--ingest n_threads] [--undirected] [--reorder rcm|degree|bfs] [--exists] [--top k] [--depth max_depth] \
+        --format [csv|json] --out [file] [--verify] [--baseline baseline_csv] [--tolerance percent]\n",
+               argv[0]);
+        exit(-1);
+    }
+
+    auto list_option = [&](const string &option, const char *def)
+    {
+        char *val = getCmdOption(argv, argv + argc, option);
+        return parseIntList((val != NULL) ? val : def);
+    };
+    auto int_option = [&](const string &option, int def)
+    {
+        char *val = getCmdOption(argv, argv + argc, option);
+        return (val != NULL) ? atoi(val) : def;
+    };
+
+    vector<int> nodes = list_option("--nodes", "1000,5000");
+    vector<int> percents = list_option("--percent", "1,35");
+    vector<int> threads = list_option("--threads", "1,2,4,8");
+    vector<int> chunks = list_option("--chunks", "2");
+
+    /* `--verify` checks the occurrences: one run per configuration, over more seeds and start nodes,
+       and the value index under random updates */
+    bool verify = cmdOptionExists(argv, argv + argc, "--verify");
+    int reps = int_option("--reps", (verify) ? 1 : 5);
+    int warmup = int_option("--warmup", (verify) ? 0 : 1);
+    vector<int> start_nodes = list_option("--start", (verify) ? "0,1,17" : to_string(default_start_node).c_str());
+    vector<int> seeds = list_option("--seed", (verify) ? "1234,1,2" : to_string(default_seed_value).c_str());
+    int search_value = int_option("--search", default_search_value);
+    int max = int_option("--max", default_max_value);
+    double tolerance = (cmdOptionExists(argv, argv + argc, "--tolerance")) ? atof(getCmdOption(argv, argv + argc, "--tolerance"))
+                                                                           : default_bench_tolerance;
+
+    map<string, double> baseline;
+    bool use_baseline = cmdOptionExists(argv, argv + argc, "--baseline");
+    if (use_baseline && !read_baseline(getCmdOption(argv, argv + argc, "--baseline"), baseline))
+        exit(-1);
+    string format = (cmdOptionExists(argv, argv + argc, "--format")) ? getCmdOption(argv, argv + argc, "--format") : "csv";
+
+    vector<string> engines;
+    string engines_opt = (cmdOptionExists(argv, argv + argc, "--engines")) ? getCmdOption(argv, argv + argc, "--engines") : "all";
+    if (engines_opt == "all")
+        engines = all_engines;
+    else
+    {
+        stringstream ss(engines_opt);
+        string e;
+        while (getline(ss, e, ','))
+            engines.push_back(e);
+    }
+
+    BfsQuery query;
+    if (!setup_query(argc, argv, &query))
+        exit(-1);
+    for (auto &e : engines)
+    {
+        if (query.bounded() && !supports_query(e))
+        {
+            fprintf(stderr, "Engine %s runs full searches only\n", e.c_str());
+            exit(-1);
+        }
+    }
+
+    vector<BenchResult> results;
+    size_t wrong_index = 0;
+    bool verify_index = verify && find(engines.begin(), engines.end(), "index") != engines.end();
+    auto bench = [&](Graph *g, CSRGraph *csr, int percent, int seed)
+    {
+        if (verify_index)
+            wrong_index += (csr != NULL) ? verify_index_updates(csr, threads.back(), max, seed)
+                                         : verify_index_updates(g, threads.back(), max, seed);
+        CompressedGraph *cg = setup_compressed(argc, argv, std::thread::hardware_concurrency(), &g, &csr);
+        if (cg != NULL)
+        {
+            bench_graph(cg, percent, seed, engines, threads, chunks, start_nodes, search_value, query, warmup, reps, results);
+            delete cg;
+        }
+        else if (csr != NULL)
+            bench_graph(csr, percent, seed, engines, threads, chunks, start_nodes, search_value, query, warmup, reps, results);
+        else
+            bench_graph(g, percent, seed, engines, threads, chunks, start_nodes, search_value, query, warmup, reps, results);
+        delete g;
+        delete csr;
+    };
+
+    if (cmdOptionExists(argv, argv + argc, "--graph"))
+    {
+        /* a single graph from file, the percent is unknown */
+        Graph *g;
+        CSRGraph *csr;
+        if (!setup_graph(argc, argv, 0, seeds[0], max, 0, &g, &csr))
+            exit(-1);
+        bench(g, csr, -1, -1);
+    }
+    else
+    {
+        for (auto &n : nodes)
+        {
+            for (auto &percent : percents)
+            {
+                for (auto &seed : seeds)
+                {
+                    Graph *g;
+                    CSRGraph *csr;
+                    if (!setup_graph(argc, argv, n, seed, max, percent, &g, &csr))
+                        exit(-1);
+                    bench(g, csr, percent, seed);
+                }
+            }
+        }
+    }
+
+    ofstream file;
+    if (cmdOptionExists(argv, argv + argc, "--out"))
+        file.open(getCmdOption(argv, argv + argc, "--out"));
+    ostream &out = (file.is_open()) ? file : cout;
+
+    if (format == "json")
+        print_json(out, results);
+    else
+        print_csv(out, results);
+
+    /* the exit status gates on the occurrences and, against a baseline, on the times */
+    size_t wrong = 0;
+    for (auto &r : results)
+        wrong += !r.ok;
+    if (wrong > 0)
+        fprintf(stderr, "%zu of %zu results with occurrences different from the sequential BFS\n", wrong, results.size());
+    if (wrong_index > 0)
+        fprintf(stderr, "%zu counts of the value index under updates different from the sequential BFS\n", wrong_index);
+    wrong += wrong_index;
+    size_t regressions = (use_baseline) ? compare_baseline(results, baseline, tolerance) : 0;
+
+    return (wrong > 0 || regressions > 0) ? -1 : 0;
+}
@@ -0,0 +1,436 @@
+/**
+ * @file bfs_engine.cpp
+ * @author Marco Costa
+ * @brief Persistent plain C++ BFS engine, reusing threads and buffers across many searches
+ * @version 0.1
+ * @date 2021-09-08
+ */
+#ifndef BFS_ENGINE_CPP
+#define BFS_ENGINE_CPP
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+
+#include "graph.cpp"
+#include "arena.cpp"
+#include "barrier.cpp"
+#include "cutoff.cpp"
+#include "bfs_policy.cpp"
+#include "config.hpp"
+
+/**
+ * @brief Long-lived BFS engine bound to one graph. The workers, the visited array and the
+ *        frontier buffers are created once by the constructor and reused by every `run`,
+ *        the workers sleep on the barrier between two searches.
+ *        The visited array is epoch stamped: a node is visited in the current search when
+ *        its stamp equals the search epoch, so starting a new search costs an increment.
+ *        A level is expanded as in `parallel_bfs_nomerge`, without merging phase, or by the
+ *        master alone below the `LevelCutoff` calibrated by the constructor.
+ *        `run_batch` answers many searches at once with the multi-source BFS on the same
+ *        workers, its visit masks are allocated by the first batch.
+ *        The levels of `run` compare the values with the predicate of `with_value_policy`,
+ *        the default search value compiled in.
+ *
+ * @tparam G the graph representation (`Graph` or `CSRGraph`)
+ * @tparam B the barrier between the levels (`Barrier` or `SpinBarrier`)
+ * @tparam Chunk the chunk size compiled in, 0 for the `chunk_size` of the constructor
+ */
+template <typename G, typename B = Barrier, int Chunk = 0>
+class BfsEngine
+{
+public:
+    BfsEngine(G *g, int n_workers, int chunk_size = CHUNK_SIZE, long cutoff = -1) : g(g),
+                                                                  n_workers(n_workers),
+                                                                  chunk_size(chunk_size),
+                                                                  stamps(new std::atomic<uint32_t>[g->n_nodes]),
+                                                                  frontiers{{g->n_nodes, n_workers}, {g->n_nodes, n_workers}},
+                                                                  partial_results(n_workers),
+                                                                  level_cutoff((cutoff > 0) ? cutoff : 0)
+    {
+        for (uint i = 0; i < g->n_nodes; i++)
+            stamps[i].store(0, std::memory_order_relaxed);
+
+        barrier = new B(n_workers);
+        for (int i = 0; i < n_workers; i++)
+            thread_ids.push_back(new std::thread(&BfsEngine::worker, this, i));
+
+        /* every worker is parked on the barrier */
+        barrier->MasterWait();
+
+        /* the cost of a level, measured on empty ones */
+        if (cutoff < 0)
+        {
+            auto empty_level = [&]()
+            {
+                barrier->StartWorkers();
+                barrier->MasterWait();
+            };
+            level_cutoff = LevelCutoff(
+                g, n_workers, [&]()
+                { return LevelCutoff::round_trip_ns(empty_level); },
+                [&](uint val)
+                { return stamps[val].load(std::memory_order_relaxed) != 0; });
+        }
+    }
+
+    ~BfsEngine()
+    {
+        shutdown = true;
+        barrier->StartWorkers();
+        for (auto &t : thread_ids)
+        {
+            t->join();
+            delete t;
+        }
+        delete barrier;
+    }
+
+    BfsEngine(const BfsEngine &) = delete;
+    BfsEngine &operator=(const BfsEngine &) = delete;
+
+    /**
+     * @brief Performs one BFS search on the graph of the engine
+     *
+     * @param start_node the starting node
+     * @param search_value the value to search
+     * @return int the occurrences found
+     */
+    int run(int start_node, int search_value)
+    {
+        new_epoch();
+        this->search_value = search_value;
+
+        for (int i = 0; i < n_workers; i++)
+            partial_results[i] = 0;
+        curr_frontier->reset();
+        stamps[start_node].store(epoch, std::memory_order_relaxed);
+        curr_frontier->push(0, start_node);
+
+        while (curr_frontier->seal() > 0)
+        {
+            size_t block = 0;
+            if (level_cutoff.sequential(curr_frontier->size(), [&](size_t j)
+                                        { return g->get_degree(curr_frontier->at(j, block)); }))
+                run_job(0, 1); /* the workers are parked */
+            else
+            {
+                barrier->StartWorkers();
+                barrier->MasterWait();
+            }
+
+            /* no merging: the blocks filled by the workers are the new frontier */
+            curr_frontier->reset();
+            std::swap(curr_frontier, new_frontier);
+        }
+
+        int total_occurrences = 0;
+        for (int i = 0; i < n_workers; i++)
+            total_occurrences += partial_results[i];
+
+        return total_occurrences;
+    }
+
+    /**
+     * @brief Performs the searches of `start_nodes` together, as `parallel_multi_source_bfs`
+     *        in batches of 64 searches, on the workers of the engine. Every level has two
+     *        phases: the workers or the masks of the new searches into `visit_next` (the first
+     *        worker to touch a node pushes it), then the master seals the new frontier and the
+     *        workers update `seen` and the counts of its chunks. The small levels are expanded
+     *        by the master alone, as in `run`.
+     *
+     * @param start_nodes the starting node of each search
+     * @param search_values the value to search of each search
+     * @return vector<int> the number of occurrences found by each search
+     */
+    std::vector<int> run_batch(const std::vector<int> &start_nodes, const std::vector<int> &search_values)
+    {
+        std::vector<int> occ(start_nodes.size());
+        if (!seen)
+        {
+            seen.reset(new uint64_t[g->n_nodes]());
+            visit.reset(new std::atomic<uint64_t>[g->n_nodes]);
+            visit_next.reset(new std::atomic<uint64_t>[g->n_nodes]);
+            for (uint i = 0; i < g->n_nodes; i++)
+            {
+                visit[i].store(0, std::memory_order_relaxed);
+                visit_next[i].store(0, std::memory_order_relaxed);
+            }
+            batch_results.assign(n_workers, std::vector<int>(batch_size));
+        }
+
+        for (size_t first = 0; first < start_nodes.size(); first += batch_size)
+        {
+            size_t n_sources = std::min(batch_size, start_nodes.size() - first);
+            batch_values = search_values.data() + first;
+
+            curr_frontier->reset();
+            for (size_t b = 0; b < n_sources; b++)
+            {
+                int s = start_nodes[first + b];
+                if (visit[s].load(std::memory_order_relaxed) == 0)
+                    curr_frontier->push(0, s);
+                visit[s].fetch_or((uint64_t)1 << b, std::memory_order_relaxed);
+                seen[s] |= (uint64_t)1 << b;
+                if (g->get_value(s) == batch_values[b])
+                    occ[first + b]++;
+            }
+
+            while (curr_frontier->seal() > 0)
+            {
+                size_t block = 0;
+                bool inline_level = level_cutoff.sequential(curr_frontier->size(), [&](size_t j)
+                                                            { return g->get_degree(curr_frontier->at(j, block)); });
+
+                for (Job phase : {Job::batch_expand, Job::batch_update})
+                {
+                    if (phase == Job::batch_update)
+                        new_frontier->seal();
+                    job = phase;
+                    if (inline_level)
+                        run_job(0, 1);
+                    else
+                    {
+                        barrier->StartWorkers();
+                        barrier->MasterWait();
+                    }
+                }
+                job = Job::level;
+
+                std::swap(visit, visit_next);
+                curr_frontier->reset();
+                std::swap(curr_frontier, new_frontier);
+            }
+
+            /* local reduce of the batch */
+            for (int i = 0; i < n_workers; i++)
+            {
+                for (size_t b = 0; b < n_sources; b++)
+                    occ[first + b] += batch_results[i][b];
+                std::fill(batch_results[i].begin(), batch_results[i].end(), 0);
+            }
+            std::fill(seen.get(), seen.get() + g->n_nodes, 0);
+        }
+
+        return occ;
+    }
+
+private:
+    G *g;
+    int n_workers;
+    int chunk_size;
+    int search_value = 0;
+
+    std::unique_ptr<std::atomic<uint32_t>[]> stamps; /* the epoch of the last search visiting each node */
+    uint32_t epoch = 0;
+
+    FrontierArena frontiers[2]; /* the frontier of the previous level and the one being filled */
+    FrontierArena *curr_frontier = &frontiers[0];
+    FrontierArena *new_frontier = &frontiers[1];
+    std::vector<int> partial_results;
+
+    /* the multi-source searches of `run_batch` */
+    static constexpr size_t batch_size = 64;
+    std::unique_ptr<uint64_t[]> seen;                     /* the searches which have visited the node */
+    std::unique_ptr<std::atomic<uint64_t>[]> visit;      /* the searches which reached the node in the last level */
+    std::unique_ptr<std::atomic<uint64_t>[]> visit_next; /* the searches which reach the node in this level */
+    std::vector<std::vector<int>> batch_results;
+    const int *batch_values = NULL;
+
+    /* what the workers do in the next generation of the barrier */
+    enum class Job
+    {
+        level,
+        batch_expand,
+        batch_update
+    };
+    Job job = Job::level;
+
+    B *barrier;
+    std::vector<std::thread *> thread_ids;
+    bool shutdown = false;
+    LevelCutoff level_cutoff;
+
+    /**
+     * @brief Starts a new search, the stamps are cleared only when the epoch wraps around
+     */
+    void new_epoch()
+    {
+        if (++epoch == 0)
+        {
+            for (uint i = 0; i < g->n_nodes; i++)
+                stamps[i].store(0, std::memory_order_relaxed);
+            epoch = 1;
+        }
+    }
+
+    /* the chunk size, a constant of the instantiation unless `Chunk` is 0 */
+    inline int chunk() const { return (Chunk > 0) ? Chunk : chunk_size; }
+
+    /* true only for the one worker which visits the node first in this search */
+    inline bool claim(uint val)
+    {
+        uint32_t seen = stamps[val].load(std::memory_order_relaxed);
+        return seen != epoch && stamps[val].compare_exchange_strong(seen, epoch, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Expands the chunks of the current frontier of the worker `thread_no` out of
+     *        `n_parts`, round robin; the master expands all of them as the worker 0 of 1
+     *
+     * @tparam Value the predicate on the values (`ValueEquals` or `ConstValueEquals<v>`)
+     */
+    template <typename Value>
+    void expand(int thread_no, int n_parts)
+    {
+        const Value match(search_value);
+        int partial_occurrences = 0;
+        size_t curr_size = curr_frontier->size();
+        size_t block = 0;
+        for (size_t start = thread_no * chunk(); start < curr_size; start += (size_t)n_parts * chunk())
+        {
+            size_t stop = std::min(start + chunk(), curr_size);
+            for (size_t j = start; j < stop; j++)
+            {
+                int curr_node = curr_frontier->at(j, block);
+
+                if (match(g->get_value(curr_node)))
+                    partial_occurrences++;
+
+                for (auto &val : g->get_adj(curr_node))
+                {
+                    if (claim(val))
+                        new_frontier->push(thread_no, val);
+                }
+            }
+        }
+        partial_results[thread_no] += partial_occurrences;
+    }
+
+    /**
+     * @brief The first phase of a level of `run_batch`: the masks of the frontier chunks of
+     *        the worker `thread_no` out of `n_parts` are or-ed into their neighbors
+     */
+    void expand_batch(int thread_no, int n_parts)
+    {
+        size_t curr_size = curr_frontier->size();
+        size_t block = 0;
+        for (size_t start = thread_no * chunk(); start < curr_size; start += (size_t)n_parts * chunk())
+        {
+            size_t stop = std::min(start + chunk(), curr_size);
+            for (size_t j = start; j < stop; j++)
+            {
+                int curr = curr_frontier->at(j, block);
+                uint64_t mask = visit[curr].load(std::memory_order_relaxed);
+                for (auto &val : g->get_adj(curr))
+                {
+                    uint64_t d = mask & ~seen[val];
+                    if (d && (visit_next[val].load(std::memory_order_relaxed) & d) != d &&
+                        visit_next[val].fetch_or(d, std::memory_order_relaxed) == 0)
+                        new_frontier->push(thread_no, val);
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief The second phase of a level of `run_batch`: the masks of the current frontier
+     *        chunks are cleared, the nodes of the new frontier chunks are marked seen and
+     *        counted, each node of a frontier is in the chunks of one worker only
+     */
+    void update_batch(int thread_no, int n_parts)
+    {
+        size_t curr_size = curr_frontier->size();
+        size_t block = 0;
+        for (size_t start = thread_no * chunk(); start < curr_size; start += (size_t)n_parts * chunk())
+        {
+            size_t stop = std::min(start + chunk(), curr_size);
+            for (size_t j = start; j < stop; j++)
+                visit[curr_frontier->at(j, block)].store(0, std::memory_order_relaxed);
+        }
+
+        std::vector<int> &partial = batch_results[thread_no];
+        size_t new_size = new_frontier->size();
+        block = 0;
+        for (size_t start = thread_no * chunk(); start < new_size; start += (size_t)n_parts * chunk())
+        {
+            size_t stop = std::min(start + chunk(), new_size);
+            for (size_t j = start; j < stop; j++)
+            {
+                int val = new_frontier->at(j, block);
+                uint64_t mask = visit_next[val].load(std::memory_order_relaxed);
+                seen[val] |= mask;
+                while (mask)
+                {
+                    int b = __builtin_ctzll(mask);
+                    if (g->get_value(val) == batch_values[b])
+                        partial[b]++;
+                    mask &= mask - 1;
+                }
+            }
+        }
+    }
+
+    /* the current job on the chunks of the worker `thread_no` out of `n_parts` */
+    inline void run_job(int thread_no, int n_parts)
+    {
+        switch (job)
+        {
+        case Job::level:
+            with_value_policy<(short)default_search_value>(search_value, [&](auto value_tag)
+                                                           {
+                expand<typename decltype(value_tag)::type>(thread_no, n_parts);
+                return 0; });
+            break;
+        case Job::batch_expand:
+            expand_batch(thread_no, n_parts);
+            break;
+        case Job::batch_update:
+            update_batch(thread_no, n_parts);
+            break;
+        }
+    }
+
+    /**
+     * @brief Worker routine, one job per generation of the barrier until the shutdown
+     */
+    void worker(int thread_no)
+    {
+        while (true)
+        {
+            barrier->WorkerWait();
+            if (shutdown)
+                return;
+
+            run_job(thread_no, n_workers);
+        }
+    }
+};
+
+/**
+ * @brief A `BfsEngine` on `g` with the chunk size compiled in when it is one of
+ *        `policy_chunk_sizes` (see `with_search_policy`), read at runtime otherwise
+ *
+ * @return std::function<int(int, int)> the `run` of the engine, which lives as long as the function
+ */
+template <typename G, typename B = Barrier>
+std::function<int(int, int)> make_policy_engine(G *g, int n_workers, int chunk_size = CHUNK_SIZE, long cutoff = -1)
+{
+    std::function<int(int, int)> run;
+    auto make = [&](auto chunk)
+    {
+        using E = BfsEngine<G, B, decltype(chunk)::value>;
+        std::shared_ptr<E> engine(new E(g, n_workers, chunk_size, cutoff));
+        run = [engine](int start_node, int search_value)
+        { return engine->run(start_node, search_value); };
+    };
+    if (!with_chunk_policy(chunk_size, make, policy_chunk_sizes()))
+        make(std::integral_constant<int, 0>());
+    return run;
+}
+
+#endif
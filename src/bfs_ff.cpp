@@ -7,88 +7,307 @@
  */
 #include <iostream>
 #include <vector>
-#include <unordered_set>
 #include <algorithm>
+#include <atomic>
+#include <memory>
+#include <cstdint>
 
 #include "ff/ff.hpp"
 #include "ff/parallel_for.hpp"
 
 #include "utimer.cpp"
+#include "trace.cpp"
 #include "graph.cpp"
+#include "bitmap.cpp"
+#include "arena.cpp"
 #include "utils.cpp"
+#include "query.cpp"
+#include "cutoff.cpp"
+#include "balance.cpp"
 #include "config.hpp"
 
 /**
- * @brief The BFS search using the FastFlow framework.
+ * @brief The cost of a `ParallelFor` loop, measured once on empty loops of an entry per worker
+ */
+double ff_loop_ns(ff::ParallelFor &pfr, int n_workers)
+{
+    return LevelCutoff::cached_ns("ff::ParallelFor", n_workers, [&]()
+                                  { return LevelCutoff::round_trip_ns([&]()
+                                                                      { pfr.parallel_for_thid(0, n_workers, 1, -1, [](const int, const int) {}); }); });
+}
+
+/**
+ * @brief The `LevelCutoff` of `ff_bfs` on the graph `g`, as its `cutoff` argument: measured
+ *        once, before the searches on the same graph
+ */
+template <typename G>
+long ff_bfs_cutoff(const G *g, int n_workers)
+{
+    ff::ParallelFor pfr(n_workers);
+    AtomicBitmap visited(g->n_nodes);
+    return LevelCutoff(
+               g, n_workers, [&]()
+               { return ff_loop_ns(pfr, n_workers); },
+               [&](uint val)
+               { return visited.test(val); })
+        .as_argument();
+}
+
+/**
+ * @brief The BFS search using the FastFlow framework. A bounded `query` is checked at the
+ *        end of each `ParallelFor` loop, no loop is started once it is satisfied.
+ *        As in `parallel_bfs`, a level with less work than the `LevelCutoff` is expanded
+ *        inline, without starting a loop, and with `edge_balance` the loop runs over the
+ *        parts of equal edges of the frontier, one per worker, instead of its entries.
  * 
+ * @tparam G the graph representation (`Graph` or `CSRGraph`)
  * @param g the Graph to which execute the search
  * @param start_node the starting node
  * @param search_value the value to search 
  * @param n_workers the number of workers
+ * @param chunk_size the number of frontier entries per chunk (static scheduling)
+ * @param query when the search can stop, the whole component by default
+ * @param cutoff the least edges plus nodes of a level expanded by the workers, calibrated by the
+ *        search if negative (see `ff_bfs_cutoff` to calibrate it once for many searches)
+ * @param edge_balance whether the levels are partitioned by edges rather than by entries
  * @return int the occurrences found
  */
-int ff_bfs(Graph *g, int start_node, int search_value, int n_workers)
+template <typename G>
+int ff_bfs(G *g, int start_node, int search_value, int n_workers, int chunk_size = CHUNK_SIZE,
+           const BfsQuery &query = BfsQuery(), long cutoff = -1, bool edge_balance = false)
 {
-    /* initialization of the data structures needed */
+    /* initialization of the data structures needed, sized once on n_nodes */
     vector<int> curr_frontier;
-    vector<vector<int>> partial_new_frontier(n_workers);
+    curr_frontier.reserve(g->n_nodes);
+    FrontierArena new_frontier(g->n_nodes, n_workers);
     vector<int> partial_results(n_workers);
-    vector<int> visited(g->n_nodes); /* used as vector<bool> (which is not concurrent) */ 
+    AtomicBitmap visited(g->n_nodes); /* shared by the workers, a node is claimed by one of them */
 
     ff::ParallelFor pfr = ff::ParallelFor(n_workers);
+    int depth = 0;
+    bool expand = query.expands(depth);
+    TRACE(BfsTrace trace("ff_bfs", n_workers); size_t level = 0;)
+
+    LevelCutoff level_cutoff((cutoff > 0) ? cutoff : 0);
+    if (cutoff < 0)
+        level_cutoff = LevelCutoff(
+            g, n_workers, [&]()
+            { return ff_loop_ns(pfr, n_workers); },
+            [&](uint val)
+            { return visited.test(val); });
 
     /* routine of each worker */
     auto f = [&](const int i, const int thread_no)
     {
         int partial_occurrences = 0;
+        TRACE(TraceThreadLevel &tl = trace.at(thread_no, level); double t_busy = BfsTrace::now_us();)
 
-#ifdef DEBUG_PRINT
-        printf("th %d: [%d, %d) {%d, %d}\n", thread_no, start, stop, curr_size, delta);
-#endif
         auto curr_node = curr_frontier[i];
 
-#ifdef DEBUG_PRINT
-        printf("Thread %d: taking %d\n", thread_no, curr_node);
-#endif
-
-        if (g->nodes[curr_node]->value == search_value)
+        if (g->get_value(curr_node) == search_value)
             partial_occurrences++;
 
-        for (auto &val : g->nodes[curr_node]->adj)
+        if (expand)
         {
-            if (visited[val] == 0) /* if not visited before */
+            for (auto &val : g->get_adj(curr_node))
             {
-                partial_new_frontier[thread_no].push_back(val);
-                visited[val] = 1;
+                if (visited.claim(val)) /* if not visited before */
+                    new_frontier.push(thread_no, val);
             }
         }
 
         partial_results[thread_no] += partial_occurrences;
+        TRACE(tl.nodes++; tl.edges += g->get_degree(curr_node); tl.busy_us += BfsTrace::now_us() - t_busy;)
+    };
+
+    /* routine of each worker on the part `part` of the equal-edge partition */
+    EdgeBalance balance;
+    auto f_part = [&](const int part, const int thread_no)
+    {
+        int partial_occurrences = 0;
+        TRACE(TraceThreadLevel &tl = trace.at(thread_no, level); double t_busy = BfsTrace::now_us();)
+        balance.for_each_in_part(
+            g, [&](size_t j)
+            { return (uint)curr_frontier[j]; },
+            part, n_workers,
+            [&](uint curr_node)
+            {
+                if (g->get_value(curr_node) == search_value)
+                    partial_occurrences++;
+                TRACE(tl.nodes++;)
+            },
+            [&](uint val)
+            {
+                TRACE(tl.edges++;)
+                if (visited.claim(val))
+                    new_frontier.push(thread_no, val);
+            });
+        partial_results[thread_no] += partial_occurrences;
+        TRACE(tl.busy_us += BfsTrace::now_us() - t_busy;)
     };
 
     curr_frontier.push_back(start_node);
-    visited[start_node] = 1;
+    visited.set(start_node);
 
-    unordered_set<int> merging_set;
     while (!curr_frontier.empty())
     {
         // dynamic scheduling performs also good but introduces too much overhead on a low number of nodes
         // round robin seems to perform the same on an high number of nodes but without overhead
         // using parallel_for_thid in order to give access to each worker to its reserved structures
-        pfr.parallel_for_thid(0, curr_frontier.size(), 1, -CHUNK_SIZE, f);
+        TRACE(size_t frontier_size = curr_frontier.size(); double t_level = BfsTrace::now_us();)
+        if (level_cutoff.sequential(curr_frontier.size(), [&](size_t j)
+                                    { return g->get_degree(curr_frontier[j]); }))
+        {
+            /* the loop workers are idle, the master takes the part of the worker 0 */
+            for (size_t i = 0; i < curr_frontier.size(); i++)
+                f(i, 0);
+        }
+        else if (edge_balance && expand)
+        {
+            balance.build(g, curr_frontier.size(), [&](size_t j)
+                          { return curr_frontier[j]; });
+            pfr.parallel_for_thid(0, n_workers, 1, 1, f_part);
+        }
+        else
+            pfr.parallel_for_thid(0, curr_frontier.size(), 1, -chunk_size, f);
+        TRACE(double t_merge = BfsTrace::now_us();)
 
-        for (size_t i = 0; i < partial_new_frontier.size(); i++)
+        if (query.bounded())
         {
-            merging_set.insert(partial_new_frontier[i].begin(), partial_new_frontier[i].end());
-            partial_new_frontier[i].clear();
+            int matches = 0;
+            for (auto &val : partial_results)
+                matches += val;
+            if (query.done(matches, depth))
+            {
+                TRACE(trace.add_level(frontier_size, t_merge - t_level, 0);)
+                break;
+            }
         }
+        expand = query.expands(++depth);
 
-        /* merging phase with sorting */
-        curr_frontier.assign(merging_set.begin(), merging_set.end());
-        merging_set.clear();
+        /* merging phase with sorting, the partial frontiers are disjoint */
+        curr_frontier.resize(new_frontier.seal());
+        new_frontier.copy_to(curr_frontier.data());
+        new_frontier.reset();
         sort(curr_frontier.begin(), curr_frontier.end());
+
+        /* the barrier of the parallel for is not visible, the waits are left out */
+        TRACE(trace.add_level(frontier_size, t_merge - t_level, BfsTrace::now_us() - t_merge); level++;)
+    }
+    TRACE(trace.print();)
+
+    /* local reduce */
+    int total_occurrences = 0;
+    for (auto &val : partial_results)
+        total_occurrences += val;
+
+    return query.result(total_occurrences);
+}
+
+/**
+ * @brief The BFS search using the FastFlow framework, without the serial merging phase.
+ *        As in `parallel_bfs_nomerge` the nodes are claimed on the `visited` bitmap
+ *        and the partial frontiers are read in place as the segments of the
+ *        next one, or the frontier is a bitmap scanned in node order.
+ *
+ * @tparam G the graph representation (`Graph` or `CSRGraph`)
+ * @param g the Graph to which execute the search
+ * @param start_node the starting node
+ * @param search_value the value to search
+ * @param n_workers the number of workers
+ * @param bitmap_frontier whether to use the bitmap frontier
+ * @param chunk_size the number of frontier entries (bitmap words) per chunk
+ * @return int the occurrences found
+ */
+template <typename G>
+int ff_bfs_nomerge(G *g, int start_node, int search_value, int n_workers, bool bitmap_frontier = false,
+                   int chunk_size = CHUNK_SIZE)
+{
+    vector<vector<int>> curr_frontier(n_workers);
+    vector<vector<int>> partial_new_frontier(n_workers);
+    vector<size_t> frontier_offsets(n_workers + 1); /* prefix sum of the segment sizes */
+    AtomicBitmap *curr_bitmap = (bitmap_frontier) ? new AtomicBitmap(g->n_nodes) : NULL;
+    AtomicBitmap *new_bitmap = (bitmap_frontier) ? new AtomicBitmap(g->n_nodes) : NULL;
+    vector<size_t> partial_discovered(n_workers);
+    vector<int> partial_results(n_workers);
+
+    AtomicBitmap visited(g->n_nodes);
+
+    ff::ParallelFor pfr = ff::ParallelFor(n_workers);
+
+    auto f_node = [&](uint curr_node, const int thread_no)
+    {
+        if (g->get_value(curr_node) == search_value)
+            partial_results[thread_no]++;
+
+        for (auto &val : g->get_adj(curr_node))
+        {
+            if (visited.claim(val))
+            {
+                if (bitmap_frontier)
+                    new_bitmap->set(val);
+                else
+                    partial_new_frontier[thread_no].push_back(val);
+                partial_discovered[thread_no]++;
+            }
+        }
+    };
+
+    /* routine of each worker on the i-th frontier entry */
+    auto f = [&](const int i, const int thread_no)
+    {
+        size_t seg = upper_bound(frontier_offsets.begin(), frontier_offsets.end(), (size_t)i) - frontier_offsets.begin() - 1;
+        f_node(curr_frontier[seg][i - frontier_offsets[seg]], thread_no);
+    };
+
+    /* routine of each worker on the w-th word of the bitmap frontier */
+    auto f_word = [&](const int w, const int thread_no)
+    {
+        curr_bitmap->for_each_in_word(w, [&](uint curr_node)
+                                      { f_node(curr_node, thread_no); });
+        curr_bitmap->clear_word(w);
+    };
+
+    visited.set(start_node);
+    if (bitmap_frontier)
+        curr_bitmap->set(start_node);
+    else
+        curr_frontier[0].push_back(start_node);
+    for (int i = 0; i < n_workers; i++)
+        frontier_offsets[i + 1] = frontier_offsets[i] + curr_frontier[i].size();
+
+    size_t curr_size = 1;
+    while (curr_size > 0)
+    {
+        if (bitmap_frontier)
+            pfr.parallel_for_thid(0, curr_bitmap->n_words, 1, -chunk_size, f_word);
+        else
+            pfr.parallel_for_thid(0, frontier_offsets[n_workers], 1, -chunk_size, f);
+
+        /* no merging: the partial frontiers become the segments of the new one */
+        curr_size = 0;
+        for (int i = 0; i < n_workers; i++)
+        {
+            curr_size += partial_discovered[i];
+            partial_discovered[i] = 0;
+        }
+
+        if (bitmap_frontier)
+            swap(curr_bitmap, new_bitmap);
+        else
+        {
+            swap(curr_frontier, partial_new_frontier);
+            for (int i = 0; i < n_workers; i++)
+            {
+                partial_new_frontier[i].clear();
+                frontier_offsets[i + 1] = frontier_offsets[i] + curr_frontier[i].size();
+            }
+        }
     }
 
+    delete curr_bitmap;
+    delete new_bitmap;
+
     /* local reduce */
     int total_occurrences = 0;
     for (auto &val : partial_results)
@@ -97,13 +316,127 @@ int ff_bfs(Graph *g, int start_node, int search_value, int n_workers)
     return total_occurrences;
 }
 
+/**
+ * @brief Long-lived FastFlow BFS engine bound to one graph: the `ff::ParallelFor`, the
+ *        epoch stamped visited array and the frontier buffers are reused by every `run`.
+ *        A level is expanded as in `ff_bfs_nomerge`, or inline below the `LevelCutoff`
+ *        calibrated by the constructor, see also `BfsEngine`.
+ *
+ * @tparam G the graph representation (`Graph` or `CSRGraph`)
+ */
+template <typename G>
+class FFBfsEngine
+{
+public:
+    FFBfsEngine(G *g, int n_workers, int chunk_size = CHUNK_SIZE, long cutoff = -1) : g(g),
+                                                                    n_workers(n_workers),
+                                                                    chunk_size(chunk_size),
+                                                                    stamps(new atomic<uint32_t>[g->n_nodes]),
+                                                                    frontiers{{g->n_nodes, n_workers}, {g->n_nodes, n_workers}},
+                                                                    partial_results(n_workers),
+                                                                    pfr(n_workers),
+                                                                    level_cutoff((cutoff > 0) ? cutoff : 0)
+    {
+        for (uint i = 0; i < g->n_nodes; i++)
+            stamps[i].store(0, memory_order_relaxed);
+
+        /* the cost of a loop, measured on empty ones of an entry per worker */
+        if (cutoff < 0)
+        {
+            level_cutoff = LevelCutoff(
+                g, n_workers, [&]()
+                { return ff_loop_ns(pfr, n_workers); },
+                [&](uint val)
+                { return stamps[val].load(memory_order_relaxed) != 0; });
+        }
+    }
+
+    /**
+     * @brief Performs one BFS search on the graph of the engine
+     *
+     * @param start_node the starting node
+     * @param search_value the value to search
+     * @return int the occurrences found
+     */
+    int run(int start_node, int search_value)
+    {
+        /* new search epoch, the stamps are cleared only when it wraps around */
+        if (++epoch == 0)
+        {
+            for (uint i = 0; i < g->n_nodes; i++)
+                stamps[i].store(0, memory_order_relaxed);
+            epoch = 1;
+        }
+
+        for (int i = 0; i < n_workers; i++)
+            partial_results[i] = 0;
+        curr_frontier->reset();
+        stamps[start_node].store(epoch, memory_order_relaxed);
+        curr_frontier->push(0, start_node);
+
+        auto f = [&](const int i, const int thread_no)
+        {
+            int curr_node = curr_frontier->at(i);
+
+            if (g->get_value(curr_node) == search_value)
+                partial_results[thread_no]++;
+
+            for (auto &val : g->get_adj(curr_node))
+            {
+                uint32_t seen = stamps[val].load(memory_order_relaxed);
+                if (seen != epoch && stamps[val].compare_exchange_strong(seen, epoch, memory_order_relaxed))
+                    new_frontier->push(thread_no, val);
+            }
+        };
+
+        size_t curr_size;
+        while ((curr_size = curr_frontier->seal()) > 0)
+        {
+            size_t block = 0;
+            if (level_cutoff.sequential(curr_size, [&](size_t j)
+                                        { return g->get_degree(curr_frontier->at(j, block)); }))
+            {
+                for (size_t i = 0; i < curr_size; i++)
+                    f(i, 0);
+            }
+            else
+                pfr.parallel_for_thid(0, curr_size, 1, -chunk_size, f);
+
+            curr_frontier->reset();
+            swap(curr_frontier, new_frontier);
+        }
+
+        int total_occurrences = 0;
+        for (auto &val : partial_results)
+            total_occurrences += val;
+
+        return total_occurrences;
+    }
+
+private:
+    G *g;
+    int n_workers;
+    int chunk_size;
+    unique_ptr<atomic<uint32_t>[]> stamps; /* the epoch of the last search visiting each node */
+    uint32_t epoch = 0;
+    FrontierArena frontiers[2];
+    FrontierArena *curr_frontier = &frontiers[0];
+    FrontierArena *new_frontier = &frontiers[1];
+    vector<int> partial_results;
+    ff::ParallelFor pfr;
+    LevelCutoff level_cutoff;
+};
+
 #ifndef TEST_CPP
 int main(int argc, char *argv[])
 {
     if (argc < 3)
     {
         printf("Usage: %s n_nodes n_threads --start [start_node] --search [search_value] \
-        --max [max_value] --seed [seed_value]\n",
+        --max [max_value] --seed [seed_value] --percent [percent_value] [--csr] \
+        [--graph graph_file] [--edges edge_list] [--ingest n_threads] [--save graph_file] [--pgen n_threads] [--undirected] [--reorder rcm|degree|bfs] [--mode pfor|nomerge|bitmap|engine] \
+        [--repeat n_searches] [--exists] [--top k] [--depth max_depth] [--compress] [--cutoff level_work] \
+        [--balance nodes|edges]\n",
                argv[0]);
         exit(-1);
     }
@@ -121,13 +454,97 @@ int main(int argc, char *argv[])
     int percent = (cmdOptionExists(argv, argv + argc, "--percent")) ? atoi(getCmdOption(argv, argv + argc, "--percent"))
                                                                     : default_percent_value;
 
-    Graph *g = Graph::generate_graph(n_nodes, seed, max, percent);
+    Graph *g;
+    CSRGraph *csr;
+    if (!setup_graph(argc, argv, n_nodes, seed, max, percent, &g, &csr))
+        exit(-1);
+    bool use_csr = (csr != NULL);
+
+    /* the start nodes are original ids, also on a relabeled graph */
+    if (use_csr)
+        start_node = csr->node_id(start_node);
+
+    string mode = (cmdOptionExists(argv, argv + argc, "--mode")) ? getCmdOption(argv, argv + argc, "--mode")
+                                                                 : "pfor";
+    if (mode != "pfor" && mode != "nomerge" && mode != "bitmap" && mode != "engine")
+    {
+        printf("Unknown mode %s\n", mode.c_str());
+        exit(-1);
+    }
+
+    /* the bounded searches are implemented by the parallel for engine */
+    BfsQuery query;
+    if (!setup_query(argc, argv, &query))
+        exit(-1);
+    if (query.bounded() && mode != "pfor")
+    {
+        printf("--exists, --top and --depth need --mode pfor\n");
+        exit(-1);
+    }
+
+    /* the compressed copy replaces the graph, built before starting the timer */
+    CompressedGraph *cg = setup_compressed(argc, argv, n_workers, &g, &csr);
+    if (cg != NULL && mode == "engine")
+    {
+        printf("--compress needs --mode pfor, nomerge or bitmap\n");
+        exit(-1);
+    }
+
+    /* the engine mode repeats the same search, reusing the engine */
+    int repeat = (cmdOptionExists(argv, argv + argc, "--repeat")) ? atoi(getCmdOption(argv, argv + argc, "--repeat"))
+                                                                  : 1;
+    /* the least edges plus nodes of a level run in parallel by the pfor and engine modes, calibrated by default */
+    long cutoff = (cmdOptionExists(argv, argv + argc, "--cutoff")) ? atol(getCmdOption(argv, argv + argc, "--cutoff"))
+                                                                   : -1;
+    /* the partition of the levels of the pfor mode, by entries or by edges */
+    string balance = (cmdOptionExists(argv, argv + argc, "--balance")) ? getCmdOption(argv, argv + argc, "--balance")
+                                                                       : "nodes";
+    if (balance != "nodes" && balance != "edges")
+    {
+        printf("Unknown balance %s\n", balance.c_str());
+        exit(-1);
+    }
+    bool edge_balance = (balance == "edges");
+
+    FFBfsEngine<CSRGraph> *csr_engine = NULL;
+    FFBfsEngine<Graph> *engine = NULL;
+    if (mode == "engine")
+    {
+        if (use_csr)
+            csr_engine = new FFBfsEngine<CSRGraph>(csr, n_workers, CHUNK_SIZE, cutoff);
+        else
+            engine = new FFBfsEngine<Graph>(g, n_workers, CHUNK_SIZE, cutoff);
+    }
+
+    /* the cutoff of the pfor mode is calibrated on the graph once, before starting the timer */
+    if (mode == "pfor" && cutoff < 0 && n_workers > 1)
+        cutoff = (cg != NULL) ? ff_bfs_cutoff(cg, n_workers) : (use_csr) ? ff_bfs_cutoff(csr, n_workers) : ff_bfs_cutoff(g, n_workers);
+
     int occ = -1;
     {
         utimer tff("tff");
-        occ = ff_bfs(g, start_node, search_value, n_workers);
+        if (mode == "engine")
+        {
+            for (int i = 0; i < repeat; i++)
+                occ = (use_csr) ? csr_engine->run(start_node, search_value) : engine->run(start_node, search_value);
+        }
+        else if (cg != NULL)
+            occ = (mode == "pfor") ? ff_bfs(cg, start_node, search_value, n_workers, CHUNK_SIZE, query, cutoff, edge_balance)
+                                   : ff_bfs_nomerge(cg, start_node, search_value, n_workers, mode == "bitmap");
+        else if (mode == "nomerge" || mode == "bitmap")
+            occ = (use_csr) ? ff_bfs_nomerge(csr, start_node, search_value, n_workers, mode == "bitmap")
+                            : ff_bfs_nomerge(g, start_node, search_value, n_workers, mode == "bitmap");
+        else
+            occ = (use_csr) ? ff_bfs(csr, start_node, search_value, n_workers, CHUNK_SIZE, query, cutoff, edge_balance)
+                            : ff_bfs(g, start_node, search_value, n_workers, CHUNK_SIZE, query, cutoff, edge_balance);
     }
     std::cout << "Occurrences: " << occ << endl;
+
+    delete engine;
+    delete csr_engine;
+    delete g;
+    delete csr;
+    delete cg;
     return 0;
 }
 #endif
\ No newline at end of file
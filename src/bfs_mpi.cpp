@@ -0,0 +1,316 @@
+/**
+ * @file bfs_mpi.cpp
+ * @author Marco Costa
+ * @brief The BFS search executable across MPI ranks, with 1D or 2D partitioning of the graph.
+ *        The partitioning divides the edges and the work of the searches, not the peak memory
+ *        of a rank: every rank still sets up the whole graph before keeping its part, and
+ *        keeps a flag per node of the graph (the nodes it has sent), so a graph must fit in
+ *        the memory of each rank. Loading only the part of a rank is not implemented.
+ * @version 0.1
+ * @date 2021-09-08
+ */
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include <mpi.h>
+
+#include "graph.cpp"
+#include "utimer.cpp"
+#include "utils.cpp"
+#include "config.hpp"
+
+/**
+ * @brief The part of the graph held by one rank of an R x C grid of ranks. The nodes are cut
+ *        in R * C equal pieces, the piece k is owned by the rank (k % R, k / R), which keeps
+ *        its values and its visited flags; the column block j is made of the pieces owned by
+ *        the grid column j, a contiguous range of nodes. The rank (i, j) stores the edges
+ *        u -> v with u in the column block j and v owned by the grid row i.
+ *        A level expands the frontier of the column block on its grid column (allgather), then
+ *        sends the discovered nodes to their owners along its grid row (all-to-all), so a
+ *        rank talks to R + C ranks instead of all of them. With R = 1 it is the 1D partitioning:
+ *        a rank stores the adjacencies of the nodes it owns and exchanges with every rank.
+ */
+class DistributedGraph
+{
+public:
+    uint n_nodes;
+    int n_rows, n_cols; /* the grid */
+    int row, col;       /* the place of this rank */
+
+    uint owned_first, owned_last; /* the nodes owned by this rank */
+    uint col_first, col_last;     /* the column block of this rank */
+
+    vector<eid_t> offsets; /* the stored edges, for the sources col_first, ..., col_last - 1 */
+    vector<uint> neighbors;
+    vector<short> values; /* of the owned nodes */
+
+    MPI_Comm row_comm; /* the ranks of the grid row, ordered by column */
+    MPI_Comm col_comm; /* the ranks of the grid column, ordered by row */
+
+    /**
+     * @brief Keeps the part of `g` of this rank, every rank is given the same (whole) graph
+     *
+     * @tparam G the graph representation (`Graph` or `CSRGraph`)
+     * @param n_rows the rows of the grid, dividing the number of ranks (1 for the 1D partitioning)
+     */
+    template <typename G>
+    DistributedGraph(const G *g, int n_rows) : n_nodes(g->n_nodes), n_rows(n_rows)
+    {
+        int rank, size;
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+        MPI_Comm_size(MPI_COMM_WORLD, &size);
+        n_cols = size / n_rows;
+        row = rank / n_cols;
+        col = rank % n_cols;
+        MPI_Comm_split(MPI_COMM_WORLD, row, col, &row_comm);
+        MPI_Comm_split(MPI_COMM_WORLD, col, row, &col_comm);
+
+        int piece = col * n_rows + row;
+        owned_first = piece_first(piece);
+        owned_last = piece_first(piece + 1);
+        col_first = piece_first(col * n_rows);
+        col_last = piece_first((col + 1) * n_rows);
+
+        offsets.push_back(0);
+        for (uint u = col_first; u < col_last; u++)
+        {
+            for (auto &val : g->get_adj(u))
+                if (row_of(val) == row)
+                    neighbors.push_back(val);
+            offsets.push_back(neighbors.size());
+        }
+        for (uint v = owned_first; v < owned_last; v++)
+            values.push_back(g->get_value(v));
+    }
+
+    ~DistributedGraph()
+    {
+        MPI_Comm_free(&row_comm);
+        MPI_Comm_free(&col_comm);
+    }
+
+    DistributedGraph(const DistributedGraph &) = delete;
+    DistributedGraph &operator=(const DistributedGraph &) = delete;
+
+    inline uint piece_first(int k) const { return (uint)((uint64_t)n_nodes * k / (n_rows * n_cols)); }
+
+    inline int piece_of(uint v) const
+    {
+        int k = (int)((uint64_t)v * (n_rows * n_cols) / max(n_nodes, 1u));
+        while (piece_first(k + 1) <= v)
+            k++;
+        while (piece_first(k) > v)
+            k--;
+        return k;
+    }
+
+    inline int row_of(uint v) const { return piece_of(v) % n_rows; }
+    inline int col_of(uint v) const { return piece_of(v) / n_rows; }
+    inline bool owns(uint v) const { return v >= owned_first && v < owned_last; }
+};
+
+/**
+ * @brief The level synchronous BFS search over the ranks, called by all of them. As in
+ *        `parallel_bfs` each rank counts the occurrences among the nodes it visits first,
+ *        the counts are summed by an all-reduce at the end.
+ *
+ * @param dg the part of the graph of this rank
+ * @param start_node the starting node
+ * @param search_value the value to search
+ * @return int the occurrences found, on every rank
+ */
+int mpi_bfs(const DistributedGraph &dg, int start_node, int search_value)
+{
+    vector<bool> visited(dg.owned_last - dg.owned_first); /* the owned nodes */
+    vector<bool> sent(dg.n_nodes);                        /* the nodes already sent by this rank, all the graph */
+    vector<uint> curr_frontier, col_frontier, received;
+    vector<vector<uint>> outgoing(dg.n_cols);
+    vector<uint> send_buf;
+    vector<int> send_counts(dg.n_cols), send_displs(dg.n_cols), recv_counts(max(dg.n_rows, dg.n_cols)),
+        recv_displs(max(dg.n_rows, dg.n_cols));
+    int partial_occurrences = 0;
+
+    auto visit = [&](uint v)
+    {
+        if (visited[v - dg.owned_first])
+            return;
+        visited[v - dg.owned_first] = true;
+        if (dg.values[v - dg.owned_first] == search_value)
+            partial_occurrences++;
+        curr_frontier.push_back(v);
+    };
+
+    if (dg.owns(start_node))
+        visit(start_node);
+
+    long global_size = 1;
+    while (global_size > 0)
+    {
+        /* expand: the frontier of the column block, gathered on the grid column */
+        int local_size = curr_frontier.size();
+        MPI_Allgather(&local_size, 1, MPI_INT, recv_counts.data(), 1, MPI_INT, dg.col_comm);
+        int total = 0;
+        for (int r = 0; r < dg.n_rows; r++)
+        {
+            recv_displs[r] = total;
+            total += recv_counts[r];
+        }
+        col_frontier.resize(total);
+        MPI_Allgatherv(curr_frontier.data(), local_size, MPI_UNSIGNED, col_frontier.data(), recv_counts.data(),
+                       recv_displs.data(), MPI_UNSIGNED, dg.col_comm);
+        curr_frontier.clear();
+
+        /* the stored edges of the frontier, each discovered node sent once to its owner */
+        for (auto &u : col_frontier)
+        {
+            for (eid_t e = dg.offsets[u - dg.col_first]; e < dg.offsets[u - dg.col_first + 1]; e++)
+            {
+                uint v = dg.neighbors[e];
+                if (!sent[v])
+                {
+                    sent[v] = true;
+                    outgoing[dg.col_of(v)].push_back(v);
+                }
+            }
+        }
+
+        /* fold: the batched all-to-all on the grid row */
+        send_buf.clear();
+        for (int c = 0; c < dg.n_cols; c++)
+        {
+            send_displs[c] = send_buf.size();
+            send_counts[c] = outgoing[c].size();
+            send_buf.insert(send_buf.end(), outgoing[c].begin(), outgoing[c].end());
+            outgoing[c].clear();
+        }
+        MPI_Alltoall(send_counts.data(), 1, MPI_INT, recv_counts.data(), 1, MPI_INT, dg.row_comm);
+        total = 0;
+        for (int c = 0; c < dg.n_cols; c++)
+        {
+            recv_displs[c] = total;
+            total += recv_counts[c];
+        }
+        received.resize(total);
+        MPI_Alltoallv(send_buf.data(), send_counts.data(), send_displs.data(), MPI_UNSIGNED, received.data(),
+                      recv_counts.data(), recv_displs.data(), MPI_UNSIGNED, dg.row_comm);
+
+        for (auto &v : received)
+            visit(v);
+
+        long new_size = curr_frontier.size();
+        MPI_Allreduce(&new_size, &global_size, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+    }
+
+    /* global reduce */
+    int total_occurrences = 0;
+    MPI_Allreduce(&partial_occurrences, &total_occurrences, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    return total_occurrences;
+}
+
+/**
+ * @brief The rows of the most square grid of `n_ranks` ranks, at most as many as the columns
+ */
+int square_grid_rows(int n_ranks)
+{
+    int rows = (int)sqrt((double)n_ranks);
+    while (n_ranks % rows != 0)
+        rows--;
+    return rows;
+}
+
+#ifndef TEST_CPP
+int main(int argc, char *argv[])
+{
+    MPI_Init(&argc, &argv);
+    int rank, n_ranks;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &n_ranks);
+
+    if (argc < 2)
+    {
+        if (rank == 0)
+            printf("Usage: mpirun -np n_ranks %s n_nodes --start [start_node] --search [search_value] \
+        --max [max_value] --seed [seed_value] --percent [percent_value] [--csr] \
+        [--graph graph_file] [--edges edge_list] [--ingest n_threads] [--pgen n_threads] \
+        [--undirected] [--reorder rcm|degree|bfs] [--partition 1d|2d] [--repeat n_searches]\n",
+                   argv[0]);
+        MPI_Finalize();
+        exit(-1);
+    }
+    int n_nodes = atoi(argv[1]);
+
+    int start_node = (cmdOptionExists(argv, argv + argc, "--start")) ? atoi(getCmdOption(argv, argv + argc, "--start"))
+                                                                     : default_start_node;
+    int search_value = (cmdOptionExists(argv, argv + argc, "--search")) ? atoi(getCmdOption(argv, argv + argc, "--search"))
+                                                                        : default_search_value;
+    int max = (cmdOptionExists(argv, argv + argc, "--max")) ? atoi(getCmdOption(argv, argv + argc, "--max"))
+                                                            : default_max_value;
+    int seed = (cmdOptionExists(argv, argv + argc, "--seed")) ? atoi(getCmdOption(argv, argv + argc, "--seed"))
+                                                              : default_seed_value;
+    int percent = (cmdOptionExists(argv, argv + argc, "--percent")) ? atoi(getCmdOption(argv, argv + argc, "--percent"))
+                                                                    : default_percent_value;
+    string partition = (cmdOptionExists(argv, argv + argc, "--partition")) ? getCmdOption(argv, argv + argc, "--partition")
+                                                                           : "1d";
+    int repeat = (cmdOptionExists(argv, argv + argc, "--repeat")) ? atoi(getCmdOption(argv, argv + argc, "--repeat"))
+                                                                  : 1;
+    if (partition != "1d" && partition != "2d")
+    {
+        if (rank == 0)
+            printf("Unknown partition %s\n", partition.c_str());
+        MPI_Finalize();
+        exit(-1);
+    }
+
+    /* every rank builds the same graph (the generators depend on the seed only, a file is mapped),
+       then keeps its part, so the graph cannot be saved by all of them at once */
+    if (cmdOptionExists(argv, argv + argc, "--save"))
+    {
+        if (rank == 0)
+            printf("--save is not supported by %s, save the graph with bfs_seq\n", argv[0]);
+        MPI_Finalize();
+        exit(-1);
+    }
+    Graph *g;
+    CSRGraph *csr;
+    if (!setup_graph(argc, argv, n_nodes, seed, max, percent, &g, &csr))
+    {
+        fprintf(stderr, "rank %d: the graph could not be set up\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+    bool use_csr = (csr != NULL);
+
+    /* the start nodes are original ids, also on a relabeled graph */
+    if (use_csr)
+        start_node = csr->node_id(start_node);
+
+    int n_rows = (partition == "2d") ? square_grid_rows(n_ranks) : 1;
+    DistributedGraph *dg = (use_csr) ? new DistributedGraph(csr, n_rows) : new DistributedGraph(g, n_rows);
+    delete g;
+    delete csr;
+
+    int occ = -1;
+    MPI_Barrier(MPI_COMM_WORLD);
+    {
+        /* timed on every rank, printed by the first one only */
+        START(tmpi);
+        for (int i = 0; i < repeat; i++)
+            occ = mpi_bfs(*dg, start_node, search_value);
+        STOP(tmpi, usec);
+        if (rank == 0)
+        {
+            std::cout << "tmpi computed in " << usec << " usec " << endl;
+            printf("Grid %d x %d of ranks, %ld usec per search\n", dg->n_rows, dg->n_cols, (long)usec / ((repeat > 0) ? repeat : 1));
+        }
+    }
+    if (rank == 0)
+        std::cout << "Occurrences: " << occ << endl;
+
+    delete dg;
+    MPI_Finalize();
+    return 0;
+}
+#endif
@@ -0,0 +1,384 @@
+/**
+ * @file bfs_policy.cpp
+ * @author Marco Costa
+ * @brief The plain C++ BFS specialized at compile time on a policy, and its runtime dispatcher.
+ *        The value predicate and the chunk size are also the compile time parameters of
+ *        `parallel_bfs` and `BfsEngine`, picked by `with_search_policy`; the visited and the
+ *        frontier policies are of `policy_bfs` only.
+ * @version 0.1
+ * @date 2021-09-08
+ */
+#ifndef BFS_POLICY_CPP
+#define BFS_POLICY_CPP
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <utility>
+#include <algorithm>
+
+#include "graph.cpp"
+#include "bitmap.cpp"
+#include "barrier.cpp"
+#include "config.hpp"
+
+/*
+ * Visited policies: `claim(i)` is true only for the one caller which visits i first.
+ */
+
+/* one bit per node, the `AtomicBitmap` of the other engines */
+class BitmapVisited
+{
+public:
+    explicit BitmapVisited(uint n_nodes) : bits(n_nodes) {}
+    inline bool claim(uint i) { return bits.claim(i); }
+
+private:
+    AtomicBitmap bits;
+};
+
+/* one byte per node: 8x the memory of the bitmap, but no read-modify-write on shared words */
+class ByteVisited
+{
+public:
+    explicit ByteVisited(uint n_nodes) : bytes(new std::atomic<uint8_t>[n_nodes])
+    {
+        for (uint i = 0; i < n_nodes; i++)
+            bytes[i].store(0, std::memory_order_relaxed);
+    }
+
+    inline bool claim(uint i)
+    {
+        return !bytes[i].load(std::memory_order_relaxed) && !bytes[i].exchange(1, std::memory_order_relaxed);
+    }
+
+private:
+    std::unique_ptr<std::atomic<uint8_t>[]> bytes;
+};
+
+/*
+ * Frontier policies: the workers `push` the nodes they claim, then the master `seal`s the
+ * frontier, which the workers traverse with `for_each` in chunks round robin. The master
+ * `reset`s a traversed frontier before it is filled again.
+ */
+
+/* per worker segments read in place, as in `parallel_bfs_nomerge` */
+class SegmentFrontier
+{
+public:
+    SegmentFrontier(uint n_nodes, int n_workers) : segments(n_workers), offsets(n_workers + 1) { (void)n_nodes; }
+
+    inline void push(int thread_no, uint node) { segments[thread_no].push_back(node); }
+
+    size_t seal()
+    {
+        for (size_t i = 0; i < segments.size(); i++)
+            offsets[i + 1] = offsets[i] + segments[i].size();
+        return offsets.back();
+    }
+
+    void reset()
+    {
+        for (auto &s : segments)
+            s.clear();
+    }
+
+    template <int chunk_size, typename F>
+    inline void for_each(int thread_no, int n_workers, F f) const
+    {
+        size_t curr_size = offsets.back();
+        size_t seg = 0;
+        for (size_t start = (size_t)thread_no * chunk_size; start < curr_size; start += (size_t)n_workers * chunk_size)
+        {
+            size_t stop = std::min(start + chunk_size, curr_size);
+            for (size_t j = start; j < stop; j++)
+            {
+                while (offsets[seg + 1] <= j)
+                    seg++;
+                f(segments[seg][j - offsets[seg]]);
+            }
+        }
+    }
+
+private:
+    std::vector<std::vector<uint>> segments;
+    std::vector<size_t> offsets;
+};
+
+/* a bitmap scanned in node order, chunks are of words; a word is cleared once scanned */
+class BitmapFrontier
+{
+public:
+    BitmapFrontier(uint n_nodes, int n_workers) : bits(n_nodes), counts(n_workers) {}
+
+    inline void push(int thread_no, uint node)
+    {
+        bits.set(node);
+        counts[thread_no].n++;
+    }
+
+    size_t seal()
+    {
+        size_t size = 0;
+        for (auto &c : counts)
+            size += c.n;
+        return size;
+    }
+
+    void reset()
+    {
+        for (auto &c : counts)
+            c.n = 0;
+    }
+
+    template <int chunk_size, typename F>
+    inline void for_each(int thread_no, int n_workers, F f)
+    {
+        size_t n_words = bits.n_words;
+        for (size_t start = (size_t)thread_no * chunk_size; start < n_words; start += (size_t)n_workers * chunk_size)
+        {
+            size_t stop = std::min(start + chunk_size, n_words);
+            for (size_t w = start; w < stop; w++)
+            {
+                bits.for_each_in_word(w, f);
+                bits.clear_word(w);
+            }
+        }
+    }
+
+private:
+    struct alignas(64) counter
+    {
+        size_t n = 0;
+    };
+
+    AtomicBitmap bits;
+    std::vector<counter> counts;
+};
+
+/*
+ * Value predicates, built from the runtime search value.
+ */
+
+struct ValueEquals
+{
+    short value;
+    explicit ValueEquals(int search_value) : value(search_value) {}
+    inline bool operator()(short v) const { return v == value; }
+};
+
+/* the search value known at compile time, the runtime one is ignored */
+template <short V>
+struct ConstValueEquals
+{
+    explicit ConstValueEquals(int) {}
+    inline bool operator()(short v) const { return v == V; }
+};
+
+/**
+ * @brief A complete configuration of `policy_bfs`
+ *
+ * @tparam Visited `BitmapVisited` or `ByteVisited`
+ * @tparam Frontier `SegmentFrontier` or `BitmapFrontier`
+ * @tparam Value `ValueEquals` or `ConstValueEquals<v>`
+ * @tparam Chunk the number of frontier entries (bitmap words) per chunk
+ */
+template <typename Visited, typename Frontier, typename Value, int Chunk>
+struct BfsPolicy
+{
+    using visited_type = Visited;
+    using frontier_type = Frontier;
+    using value_type = Value;
+    static constexpr int chunk_size = Chunk;
+};
+
+/**
+ * @brief The BFS search using the plain C++, with every choice of the inner loop fixed by
+ *        the policy `P`, so the compiler can specialize it. The levels are as in
+ *        `parallel_bfs_nomerge`: nodes claimed on `visited` and no merging phase.
+ *
+ * @tparam P the `BfsPolicy`
+ * @tparam B the barrier between the levels (`Barrier` or `SpinBarrier`)
+ * @tparam G the graph representation (`Graph` or `CSRGraph`)
+ * @param g the Graph to which execute the search
+ * @param start_node the starting node
+ * @param search_value the value to search
+ * @param n_workers the number of workers
+ * @return int the occurrences found
+ */
+template <typename P, typename B = Barrier, typename G>
+int policy_bfs(G *g, int start_node, int search_value, int n_workers)
+{
+    using Frontier = typename P::frontier_type;
+
+    typename P::visited_type visited(g->n_nodes);
+    Frontier frontiers[2] = {Frontier(g->n_nodes, n_workers), Frontier(g->n_nodes, n_workers)};
+    Frontier *curr_frontier = &frontiers[0];
+    Frontier *new_frontier = &frontiers[1];
+    const typename P::value_type match(search_value);
+    std::vector<int> partial_results(n_workers);
+
+    B *barrier = new B(n_workers);
+    bool game_over = false;
+
+    auto f = [&](int thread_no)
+    {
+        int partial_occurrences = 0;
+        while (!game_over)
+        {
+            curr_frontier->template for_each<P::chunk_size>(thread_no, n_workers, [&](uint curr_node)
+                                                             {
+                partial_occurrences += match(g->get_value(curr_node));
+                for (auto &val : g->get_adj(curr_node))
+                {
+                    if (visited.claim(val))
+                        new_frontier->push(thread_no, val);
+                } });
+
+            barrier->WorkerWait();
+        }
+
+        partial_results[thread_no] = partial_occurrences;
+    };
+
+    visited.claim(start_node);
+    curr_frontier->push(0, start_node);
+    size_t curr_size = curr_frontier->seal();
+
+    std::vector<std::thread *> thread_ids(n_workers);
+    for (int i = 0; i < n_workers; i++)
+        thread_ids[i] = new std::thread(f, i);
+
+    bool first_iteration = true;
+    while (curr_size > 0)
+    {
+        if (!first_iteration)
+            barrier->StartWorkers();
+        else
+            first_iteration = false;
+
+        barrier->MasterWait();
+
+        curr_frontier->reset();
+        std::swap(curr_frontier, new_frontier);
+        curr_size = curr_frontier->seal();
+    }
+
+    game_over = true;
+    barrier->StartWorkers();
+
+    int total_occurrences = 0;
+    for (int i = 0; i < n_workers; i++)
+    {
+        thread_ids[i]->join();
+        total_occurrences += partial_results[i];
+        delete thread_ids[i];
+    }
+
+    delete barrier;
+
+    return total_occurrences;
+}
+
+/**
+ * @brief The runtime choice among the instantiated policies: "bitmap" or "bytes" visited,
+ *        "queue" or "bitmap" frontier and one of `policy_chunk_sizes`. The default search
+ *        value is compiled in, the others are compared at runtime.
+ */
+struct BfsPolicyConfig
+{
+    std::string visited = "bitmap";
+    std::string frontier = "queue";
+    int chunk_size = CHUNK_SIZE;
+};
+
+template <int... chunks>
+struct policy_chunk_list
+{
+};
+using policy_chunk_sizes = policy_chunk_list<1, CHUNK_SIZE, 16, 64>;
+
+template <typename T>
+struct policy_tag
+{
+    using type = T;
+};
+
+/* calls f(policy_tag<ConstValueEquals<v>>) if the search value is one of `vs`, f(policy_tag<ValueEquals>) otherwise */
+template <short... vs, typename F>
+int with_value_policy(int search_value, F f)
+{
+    int occ = -1;
+    bool found = ((search_value == vs && (occ = f(policy_tag<ConstValueEquals<vs>>()), true)) || ...);
+    return (found) ? occ : f(policy_tag<ValueEquals>());
+}
+
+template <typename F, int... chunks>
+bool with_chunk_policy(int chunk_size, F f, policy_chunk_list<chunks...>)
+{
+    return ((chunk_size == chunks && (f(std::integral_constant<int, chunks>()), true)) || ...);
+}
+
+/**
+ * @brief Calls f(value_tag, chunk) with the value predicate and the chunk size of a search:
+ *        `ConstValueEquals` for the default search value, `ValueEquals` otherwise, and one of
+ *        `policy_chunk_sizes` as a constant, or `std::integral_constant<int, 0>` for a chunk
+ *        size not instantiated, which the engines then read at runtime
+ *
+ * @return int what f returns
+ */
+template <typename F>
+int with_search_policy(int search_value, int chunk_size, F f)
+{
+    return with_value_policy<(short)default_search_value>(search_value, [&](auto value_tag)
+                                                          {
+        int occ = -1;
+        if (!with_chunk_policy(chunk_size, [&](auto chunk)
+                               { occ = f(value_tag, chunk); },
+                               policy_chunk_sizes()))
+            occ = f(value_tag, std::integral_constant<int, 0>());
+        return occ; });
+}
+
+/**
+ * @brief Runs the `policy_bfs` instantiated for the configuration `config`
+ *
+ * @param occurrences set to the occurrences found
+ * @return bool false if the configuration is not instantiated
+ */
+template <typename B = Barrier, typename G>
+bool dispatch_policy_bfs(G *g, int start_node, int search_value, int n_workers, const BfsPolicyConfig &config,
+                         int *occurrences)
+{
+    auto with_frontier = [&](auto visited_tag)
+    {
+        auto with_chunk = [&](auto frontier_tag)
+        {
+            return with_chunk_policy(config.chunk_size, [&](auto chunk)
+                                     {
+                *occurrences = with_value_policy<(short)default_search_value>(search_value, [&](auto value_tag)
+                                                                              {
+                    using P = BfsPolicy<typename decltype(visited_tag)::type, typename decltype(frontier_tag)::type,
+                                        typename decltype(value_tag)::type, decltype(chunk)::value>;
+                    return policy_bfs<P, B>(g, start_node, search_value, n_workers); });
+                return true; },
+                                     policy_chunk_sizes());
+        };
+
+        if (config.frontier == "queue")
+            return with_chunk(policy_tag<SegmentFrontier>());
+        if (config.frontier == "bitmap")
+            return with_chunk(policy_tag<BitmapFrontier>());
+        return false;
+    };
+
+    if (config.visited == "bitmap")
+        return with_frontier(policy_tag<BitmapVisited>());
+    if (config.visited == "bytes")
+        return with_frontier(policy_tag<ByteVisited>());
+    return false;
+}
+
+#endif
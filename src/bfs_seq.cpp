@@ -7,21 +7,28 @@
  */
 #include <iostream>
 #include <queue>
+#include <vector>
+#include <cstdint>
 
 #include "graph.cpp"
 #include "utimer.cpp"
 #include "utils.cpp"
+#include "query.cpp"
+#include "prefetch.cpp"
 #include "config.hpp"
 
 /**
  * @brief The classical BFS sequential search
  * 
+ * @tparam G the graph representation (`Graph` or `CSRGraph`)
  * @param g the graph where to perform the search
  * @param start_node the starting node
  * @param search_value the value to search
+ * @param query when the search can stop, the whole component by default
  * @return int the number of occurrences found
  */
-int sequential_bfs(Graph *g, int start_node, int search_value)
+template <typename G>
+int sequential_bfs(G *g, int start_node, int search_value, const BfsQuery &query = BfsQuery())
 {
     int occ = 0;
 
@@ -30,39 +37,204 @@ int sequential_bfs(Graph *g, int start_node, int search_value)
 
     q.push(start_node);
     visited[start_node] = true;
+    int depth = 0;
+    size_t level_left = 1; /* nodes of the level `depth` still in the queue */
 
     while (!q.empty())
     {
         int curr = q.front();
         q.pop();
 
-#ifdef DEBUG_PRINT
-        printf("(%d, %d, %d), ", curr, g->nodes[curr]->value, d[curr]);
-#endif
+        if (g->get_value(curr) == search_value && ++occ == query.max_matches)
+            break; /* the queue is in distance order, these are the nearest matches */
 
-        if (g->nodes[curr]->value == search_value)
-            occ++;
+        if (query.expands(depth))
+        {
+            for (auto &val : g->get_adj(curr))
+            {
+                if (!visited[val]) /* if has not been visited before */
+                {
+                    q.push(val);
+                    visited[val] = true;
+                }
+            }
+        }
+
+        if (--level_left == 0)
+        {
+            depth++;
+            level_left = q.size();
+        }
+    }
+
+    return query.result(occ);
+}
+
+/**
+ * @brief The sequential BFS search with the prefetch pipeline of `for_each_prefetched`,
+ *        `prefetch_distance` entries ahead: the queue is a vector read one level at a time,
+ *        so the entries ahead are known, and the visited nodes are a bitmap whose words can
+ *        be prefetched. A bounded `query` stops at the end of a level, as the parallel engines.
+ *
+ * @tparam G the graph representation (`Graph`, `CSRGraph` or `CompressedGraph`)
+ * @param g the graph where to perform the search
+ * @param start_node the starting node
+ * @param search_value the value to search
+ * @param query when the search can stop, the whole component by default
+ * @return int the number of occurrences found
+ */
+template <typename G>
+int sequential_bfs_prefetch(G *g, int start_node, int search_value, const BfsQuery &query = BfsQuery())
+{
+    int occ = 0;
+
+    vector<uint> q; /* every node is queued once, so it is never reallocated */
+    q.reserve(g->n_nodes);
+    vector<uint64_t> visited((g->n_nodes + 63) / 64);
+    auto prefetch = [&](uint val)
+    { __builtin_prefetch(&visited[val >> 6], 1); };
+
+    q.push_back(start_node);
+    visited[start_node >> 6] |= (uint64_t)1 << (start_node & 63);
+
+    size_t first = 0;
+    for (int depth = 0; first < q.size(); depth++)
+    {
+        size_t last = q.size();
+        bool expand = query.expands(depth);
+
+        for_each_prefetched(
+            g, last - first, [&](size_t t)
+            { return q[first + t]; },
+            prefetch, [&](uint curr)
+            {
+                if (g->get_value(curr) == search_value)
+                    occ++;
+                if (!expand)
+                    return;
+
+                for_each_neighbor_prefetched(g->get_adj(curr), prefetch, [&](uint val)
+                                             {
+                    uint64_t mask = (uint64_t)1 << (val & 63);
+                    if (!(visited[val >> 6] & mask)) /* if has not been visited before */
+                    {
+                        visited[val >> 6] |= mask;
+                        q.push_back(val);
+                    } });
+            });
+
+        if (query.done(occ, depth))
+            break;
+        first = last;
+    }
+
+    return query.result(occ);
+}
+
+/**
+ * @brief The multi-source BFS (MS-BFS): up to 64 searches share every level, each node
+ *        keeps a 64-bit mask of the searches which have visited it and each frontier
+ *        node carries the mask of the searches which reached it in the last level, so
+ *        an edge is scanned once per level for the whole batch. Longer lists of start
+ *        nodes are processed in batches of 64.
+ *
+ * @tparam G the graph representation (`Graph` or `CSRGraph`)
+ * @param g the graph where to perform the search
+ * @param start_nodes the starting node of each search
+ * @param search_values the value to search of each search
+ * @return vector<int> the number of occurrences found by each search
+ */
+template <typename G>
+vector<int> multi_source_bfs(G *g, const vector<int> &start_nodes, const vector<int> &search_values)
+{
+    const size_t batch_size = 64;
+    vector<int> occ(start_nodes.size());
+
+    vector<uint64_t> seen(g->n_nodes);       /* the searches which have visited the node */
+    vector<uint64_t> visit(g->n_nodes);      /* the searches which reached the node in the last level */
+    vector<uint64_t> visit_next(g->n_nodes); /* the searches which reach the node in this level */
+    vector<int> curr_frontier, new_frontier;
 
-        for (auto &val : g->nodes[curr]->adj)
+    for (size_t first = 0; first < start_nodes.size(); first += batch_size)
+    {
+        size_t n_sources = min(batch_size, start_nodes.size() - first);
+
+        /* counts the searches in `mask` for which the node matches */
+        auto count = [&](int node, uint64_t mask)
+        {
+            while (mask)
+            {
+                int b = __builtin_ctzll(mask);
+                if (g->get_value(node) == search_values[first + b])
+                    occ[first + b]++;
+                mask &= mask - 1;
+            }
+        };
+
+        for (size_t b = 0; b < n_sources; b++)
+        {
+            int s = start_nodes[first + b];
+            if (visit[s] == 0)
+                curr_frontier.push_back(s);
+            visit[s] |= (uint64_t)1 << b;
+            seen[s] |= (uint64_t)1 << b;
+        }
+        for (auto &s : curr_frontier)
+            count(s, visit[s]);
+
+        while (!curr_frontier.empty())
         {
-            if (!visited[val]) /* if has not been visited before */
+            for (auto &curr : curr_frontier)
             {
-                q.push(val);
-                visited[val] = true;
+                for (auto &val : g->get_adj(curr))
+                {
+                    uint64_t d = visit[curr] & ~seen[val];
+                    if (d)
+                    {
+                        if (visit_next[val] == 0)
+                            new_frontier.push_back(val);
+                        visit_next[val] |= d;
+                    }
+                }
             }
+
+            for (auto &curr : curr_frontier)
+                visit[curr] = 0;
+            for (auto &val : new_frontier)
+            {
+                seen[val] |= visit_next[val];
+                count(val, visit_next[val]);
+            }
+
+            swap(visit, visit_next);
+            swap(curr_frontier, new_frontier);
+            new_frontier.clear();
         }
+
+        fill(seen.begin(), seen.end(), 0);
     }
 
     return occ;
 }
 
+/**
+ * @brief The multi-source BFS with the same value to search for every start node
+ */
+template <typename G>
+vector<int> multi_source_bfs(G *g, const vector<int> &start_nodes, int search_value)
+{
+    return multi_source_bfs(g, start_nodes, vector<int>(start_nodes.size(), search_value));
+}
+
 #ifndef TEST_CPP
 int main(int argc, char *argv[])
 {
     if (argc < 2)
     {
         printf("Usage: %s n_nodes --start [start_node] --search [search_value] \
-        --max [max_value] --seed [seed_value]\n",
+        --max [max_value] --seed [seed_value] --percent [percent_value] [--csr] \
+        [--graph graph_file] [--edges edge_list] [--ingest n_threads] [--save graph_file] [--pgen n_threads] [--undirected] [--reorder rcm|degree|bfs] [--sources start_node,...] \
+        [--exists] [--top k] [--depth max_depth] [--compress] [--prefetch distance]\n",
                argv[0]);
         exit(-1);
     }
@@ -79,15 +251,73 @@ int main(int argc, char *argv[])
     int percent = (cmdOptionExists(argv, argv + argc, "--percent")) ? atoi(getCmdOption(argv, argv + argc, "--percent"))
                                                                     : default_percent_value;
 
-    Graph *g = Graph::generate_graph(n_nodes, seed, max, percent);
+    Graph *g;
+    CSRGraph *csr;
+    if (!setup_graph(argc, argv, n_nodes, seed, max, percent, &g, &csr))
+        exit(-1);
+    bool use_csr = (csr != NULL);
+
+    /* the start nodes are original ids, also on a relabeled graph */
+    if (use_csr)
+        start_node = csr->node_id(start_node);
+
+    BfsQuery query;
+    if (!setup_query(argc, argv, &query))
+        exit(-1);
+
+    /* the compressed copy replaces the graph, built before starting the timer */
+    CompressedGraph *cg = setup_compressed(argc, argv, 1, &g, &csr);
+
+    /* the multi-source search, one count per start node */
+    if (cmdOptionExists(argv, argv + argc, "--sources"))
+    {
+        if (query.bounded() || cg != NULL)
+        {
+            printf("--sources runs full searches on the uncompressed graph only\n");
+            exit(-1);
+        }
+        vector<int> orig_start_nodes = parseIntList(getCmdOption(argv, argv + argc, "--sources"));
+        vector<int> start_nodes;
+        for (auto &s : orig_start_nodes)
+            start_nodes.push_back((use_csr) ? csr->node_id(s) : s);
+        vector<int> occs;
+        {
+            utimer tseq("tseq");
+            occs = (use_csr) ? multi_source_bfs(csr, start_nodes, search_value) : multi_source_bfs(g, start_nodes, search_value);
+        }
+        for (size_t i = 0; i < start_nodes.size(); i++)
+            std::cout << "Occurrences[" << orig_start_nodes[i] << "]: " << occs[i] << endl;
+
+        delete g;
+        delete csr;
+        return 0;
+    }
+
+    /* the prefetching search, `--prefetch distance` entries ahead */
+    if (cmdOptionExists(argv, argv + argc, "--prefetch"))
+        prefetch_distance = atol(getCmdOption(argv, argv + argc, "--prefetch"));
+
     int occ = -1;
     {
         utimer tseq("tseq");
-        occ = sequential_bfs(g, start_node, search_value);
+        if (prefetch_distance > 0)
+        {
+            if (cg != NULL)
+                occ = sequential_bfs_prefetch(cg, start_node, search_value, query);
+            else
+                occ = (use_csr) ? sequential_bfs_prefetch(csr, start_node, search_value, query)
+                                : sequential_bfs_prefetch(g, start_node, search_value, query);
+        }
+        else if (cg != NULL)
+            occ = sequential_bfs(cg, start_node, search_value, query);
+        else
+            occ = (use_csr) ? sequential_bfs(csr, start_node, search_value, query) : sequential_bfs(g, start_node, search_value, query);
     }
     std::cout << "Occurrences: " << occ << endl;
 
     delete g;
+    delete csr;
+    delete cg;
     return 0;
 }
 #endif
\ No newline at end of file
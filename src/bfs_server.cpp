@@ -0,0 +1,436 @@
+/**
+ * @file bfs_server.cpp
+ * @author Marco Costa
+ * @brief The BFS search server: the graph is set up once and kept in memory, the queries come
+ *        from stdin or from TCP clients and the concurrent ones are batched
+ * @version 0.1
+ * @date 2021-09-08
+ */
+#define TEST_CPP /* excludes the main of the engines */
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "bfs_seq.cpp"
+#include "bfs_engine.cpp"
+#include "barrier.cpp"
+#include "utimer.cpp"
+#include "utils.cpp"
+#include "config.hpp"
+
+/*
+ * The protocol is line based. A query is `start_node search_value [mode]`, the start node an
+ * original id, the mode one of
+ *   batch   (default) shares a multi-source search with the other batch queries pending,
+ *   engine  runs alone on the workers of the engine,
+ *   seq     runs the sequential BFS on the server thread;
+ * it is answered by `start_node search_value mode occurrences latency_usec`, the latency from
+ * the read of the query to its answer, or by `error message`. `quit` closes the connection,
+ * `shutdown` stops the server once the pending queries are answered. On stdin the server stops
+ * at the end of the input.
+ */
+
+/**
+ * @brief A query read from a client, answered with the other queries of its batch
+ */
+struct ServerQuery
+{
+    size_t client;
+    int start_node; /* the original id, as sent */
+    int search_value = 0;
+    string mode = "batch";
+    std::chrono::steady_clock::time_point arrival;
+    std::chrono::steady_clock::time_point answered;
+    int occurrences = -1;
+    string error; /* empty if the query is valid */
+};
+
+/**
+ * @brief A connection, stdin and stdout when the server is not listening on a port
+ */
+struct ServerClient
+{
+    int in_fd;
+    int out_fd;
+    string buffer;        /* what follows the last complete line read */
+    bool closing = false; /* closed once its pending queries are answered */
+
+    ServerClient(int in_fd, int out_fd) : in_fd(in_fd), out_fd(out_fd) {}
+};
+
+/**
+ * @brief Parses the query `line` into `q`, `n_nodes` bounds the start node
+ *
+ * @return bool false if the line is not a query, with the reason in `q->error`
+ */
+bool parse_query(const string &line, uint n_nodes, ServerQuery *q)
+{
+    istringstream ss(line);
+    long start, value;
+    if (!(ss >> start >> value))
+    {
+        q->error = "expected start_node search_value [batch|engine|seq]";
+        return false;
+    }
+    string mode, rest;
+    if (ss >> mode)
+        q->mode = mode;
+    if (ss >> rest)
+    {
+        q->error = "unexpected " + rest;
+        return false;
+    }
+    if (q->mode != "batch" && q->mode != "engine" && q->mode != "seq")
+    {
+        q->error = "unknown mode " + q->mode;
+        return false;
+    }
+    if (start < 0 || start >= (long)n_nodes)
+    {
+        q->error = "start node out of range";
+        return false;
+    }
+    q->start_node = start;
+    q->search_value = value;
+    return true;
+}
+
+/* writes all of `s` on `fd`, false if the peer is gone */
+bool write_all(int fd, const string &s)
+{
+    size_t done = 0;
+    while (done < s.size())
+    {
+        ssize_t n = write(fd, s.data() + done, s.size() - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        done += n;
+    }
+    return true;
+}
+
+/**
+ * @brief The socket listening on the loopback interface at `port`
+ *
+ * @return int the socket, -1 if it could not be opened
+ */
+int listen_on(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        perror("socket");
+        return -1;
+    }
+    int yes = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0)
+    {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Answers the queries of a batch: the batch queries with one multi-source search on
+ *        the engine (a plain search if alone), then the others one by one
+ *
+ * @tparam G the graph representation (`Graph`, `CSRGraph` or `CompressedGraph`)
+ * @tparam E the engine, a `BfsEngine` on the graph
+ */
+template <typename G, typename E>
+void answer_batch(G *g, E &engine, vector<ServerQuery> &batch)
+{
+    vector<int> start_nodes, search_values;
+    vector<size_t> batched;
+    for (size_t i = 0; i < batch.size(); i++)
+    {
+        if (batch[i].error.empty() && batch[i].mode == "batch")
+        {
+            batched.push_back(i);
+            start_nodes.push_back(g->node_id(batch[i].start_node));
+            search_values.push_back(batch[i].search_value);
+        }
+    }
+
+    if (batched.size() == 1)
+        batch[batched[0]].occurrences = engine.run(start_nodes[0], search_values[0]);
+    else if (batched.size() > 1)
+    {
+        vector<int> occ = engine.run_batch(start_nodes, search_values);
+        for (size_t k = 0; k < batched.size(); k++)
+            batch[batched[k]].occurrences = occ[k];
+    }
+    auto now = std::chrono::steady_clock::now();
+    for (auto &i : batched)
+        batch[i].answered = now;
+
+    for (auto &q : batch)
+    {
+        if (!q.error.empty() || q.mode == "batch")
+            continue;
+        uint s = g->node_id(q.start_node);
+        q.occurrences = (q.mode == "engine") ? engine.run(s, q.search_value) : sequential_bfs(g, s, q.search_value);
+        q.answered = std::chrono::steady_clock::now();
+    }
+}
+
+/**
+ * @brief Serves the queries on the graph `g` until the end of stdin, or until a `shutdown`
+ *        when listening on a socket. A batch is made of the queries read by one round of
+ *        `poll` over all the clients, so the queries sent while the previous batch was being
+ *        answered are answered together; with `window_us` > 0 the batch also waits that long
+ *        after its first query for more of them.
+ *
+ * @tparam B the barrier of the engine (`Barrier` or `SpinBarrier`)
+ * @tparam G the graph representation (`Graph`, `CSRGraph` or `CompressedGraph`)
+ * @param listen_fd the listening socket, -1 to serve stdin
+ * @param cutoff the cutoff of the engine, -1 to calibrate it
+ */
+template <typename B, typename G>
+void serve(G *g, int n_workers, long cutoff, int listen_fd, int window_us)
+{
+    BfsEngine<G, B, CHUNK_SIZE> engine(g, n_workers, CHUNK_SIZE, cutoff);
+
+    vector<ServerClient> clients;
+    if (listen_fd < 0)
+        clients.emplace_back(STDIN_FILENO, STDOUT_FILENO);
+
+    vector<ServerQuery> pending;
+    size_t n_queries = 0, n_batches = 0;
+    double total_latency_us = 0;
+    bool running = true;
+
+    /* drops the closed clients, once no pending query refers to them */
+    auto drop_closed = [&]()
+    {
+        for (size_t c = clients.size(); c-- > 0;)
+        {
+            if (clients[c].closing || !running)
+            {
+                if (clients[c].in_fd != STDIN_FILENO)
+                    close(clients[c].in_fd);
+                clients.erase(clients.begin() + c);
+            }
+        }
+    };
+
+    while (running || !pending.empty())
+    {
+        if (listen_fd < 0 && clients.empty() && pending.empty())
+            break;
+
+        /* waits for input, only up to the end of the window of a pending batch */
+        vector<pollfd> fds;
+        if (listen_fd >= 0 && running)
+            fds.push_back({listen_fd, POLLIN, 0});
+        for (auto &c : clients)
+            fds.push_back({(c.closing || !running) ? -1 : c.in_fd, POLLIN, 0});
+        int timeout = -1;
+        if (!pending.empty())
+        {
+            auto waited = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -
+                                                                                pending[0].arrival);
+            timeout = (waited.count() >= window_us) ? 0 : (window_us - waited.count() + 999) / 1000;
+        }
+        if (poll(fds.data(), fds.size(), timeout) < 0 && errno != EINTR)
+        {
+            perror("poll");
+            break;
+        }
+
+        size_t f = 0;
+        if (listen_fd >= 0 && running)
+        {
+            if (fds[f++].revents & POLLIN)
+            {
+                int fd = accept(listen_fd, NULL, NULL);
+                if (fd >= 0)
+                    clients.emplace_back(fd, fd);
+            }
+        }
+
+        for (size_t c = 0; f < fds.size(); c++, f++)
+        {
+            if (fds[f].fd < 0 || fds[f].revents == 0)
+                continue;
+
+            char buf[4096];
+            ssize_t n = read(clients[c].in_fd, buf, sizeof(buf));
+            if (n > 0)
+                clients[c].buffer.append(buf, n);
+            else
+            {
+                /* the end of the input, the last line may have no newline */
+                clients[c].closing = true;
+                if (!clients[c].buffer.empty())
+                    clients[c].buffer += '\n';
+            }
+
+            size_t pos;
+            while (!clients[c].buffer.empty() && (pos = clients[c].buffer.find('\n')) != string::npos)
+            {
+                string line = clients[c].buffer.substr(0, pos);
+                clients[c].buffer.erase(0, pos + 1);
+                if (!line.empty() && line.back() == '\r')
+                    line.pop_back();
+                if (line.find_first_not_of(" \t") == string::npos)
+                    continue;
+
+                if (line == "quit")
+                {
+                    clients[c].closing = true;
+                    break;
+                }
+                if (line == "shutdown")
+                {
+                    running = false;
+                    break;
+                }
+
+                ServerQuery q;
+                q.client = c;
+                q.arrival = std::chrono::steady_clock::now();
+                parse_query(line, g->n_nodes, &q);
+                pending.push_back(q);
+            }
+            if (clients[c].buffer.size() > default_server_max_line)
+            {
+                write_all(clients[c].out_fd, "error line too long\n");
+                clients[c].buffer.clear();
+                clients[c].closing = true;
+            }
+        }
+
+        if (pending.empty())
+        {
+            drop_closed();
+            continue;
+        }
+
+        auto waited = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -
+                                                                            pending[0].arrival);
+        if (running && waited.count() < window_us)
+            continue;
+
+        answer_batch(g, engine, pending);
+        n_batches++;
+
+        vector<string> replies(clients.size());
+        for (auto &q : pending)
+        {
+            if (!q.error.empty())
+            {
+                replies[q.client] += "error " + q.error + "\n";
+                continue;
+            }
+            double latency_us = std::chrono::duration<double, std::micro>(q.answered - q.arrival).count();
+            total_latency_us += latency_us;
+            n_queries++;
+            replies[q.client] += to_string(q.start_node) + " " + to_string(q.search_value) + " " + q.mode + " " +
+                                 to_string(q.occurrences) + " " + to_string((long)latency_us) + "\n";
+        }
+        for (size_t c = 0; c < clients.size(); c++)
+        {
+            if (!replies[c].empty() && !write_all(clients[c].out_fd, replies[c]))
+                clients[c].closing = true; /* the peer is gone */
+        }
+        pending.clear();
+        drop_closed();
+    }
+
+    fprintf(stderr, "Answered %zu queries in %zu batches, %.0f usec of average latency\n", n_queries, n_batches,
+            (n_queries > 0) ? total_latency_us / n_queries : 0.0);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        printf("Usage: %s n_nodes n_threads --start [start_node] --max [max_value] --seed [seed_value] \
+        --percent [percent_value] [--csr] [--graph graph_file] [--edges edge_list] [--ingest n_threads] \
+        [--pgen n_threads] [--undirected] [--reorder rcm|degree|bfs] [--compress] [--barrier cond|spin] \
+        [--cutoff level_work] [--port port] [--window usec]\n",
+               argv[0]);
+        exit(-1);
+    }
+    int n_nodes = atoi(argv[1]);
+    int n_workers = atoi(argv[2]);
+
+    int max = (cmdOptionExists(argv, argv + argc, "--max")) ? atoi(getCmdOption(argv, argv + argc, "--max"))
+                                                            : default_max_value;
+    int seed = (cmdOptionExists(argv, argv + argc, "--seed")) ? atoi(getCmdOption(argv, argv + argc, "--seed"))
+                                                              : default_seed_value;
+    int percent = (cmdOptionExists(argv, argv + argc, "--percent")) ? atoi(getCmdOption(argv, argv + argc, "--percent"))
+                                                                    : default_percent_value;
+    long cutoff = (cmdOptionExists(argv, argv + argc, "--cutoff")) ? atol(getCmdOption(argv, argv + argc, "--cutoff"))
+                                                                   : -1;
+    int window_us = (cmdOptionExists(argv, argv + argc, "--window")) ? atoi(getCmdOption(argv, argv + argc, "--window"))
+                                                                     : default_server_window;
+    bool spin = cmdOptionExists(argv, argv + argc, "--barrier") && string(getCmdOption(argv, argv + argc, "--barrier")) == "spin";
+
+    /* the graph is set up once, mapped from the file with `--graph`; stdout is left to the answers */
+    Graph *g;
+    CSRGraph *csr;
+    START(tsetup);
+    if (!setup_graph(argc, argv, n_nodes, seed, max, percent, &g, &csr))
+        exit(-1);
+    CompressedGraph *cg = setup_compressed(argc, argv, n_workers, &g, &csr);
+    STOP(tsetup, setup_usec);
+
+    int listen_fd = -1;
+    if (cmdOptionExists(argv, argv + argc, "--port"))
+    {
+        listen_fd = listen_on(atoi(getCmdOption(argv, argv + argc, "--port")));
+        if (listen_fd < 0)
+            exit(-1);
+    }
+    signal(SIGPIPE, SIG_IGN); /* a client gone is noticed by the write */
+
+    uint n = (cg != NULL) ? cg->n_nodes : (csr != NULL) ? csr->n_nodes : g->n_nodes;
+    fprintf(stderr, "Graph set up in %ld usec, serving %u nodes with %d workers on %s\n", (long)setup_usec, n, n_workers,
+            (listen_fd >= 0) ? ("port " + string(getCmdOption(argv, argv + argc, "--port"))).c_str() : "stdin");
+
+    auto run = [&](auto *graph)
+    {
+        if (spin)
+            serve<SpinBarrier>(graph, n_workers, cutoff, listen_fd, window_us);
+        else
+            serve<Barrier>(graph, n_workers, cutoff, listen_fd, window_us);
+    };
+    if (cg != NULL)
+        run(cg);
+    else if (csr != NULL)
+        run(csr);
+    else
+        run(g);
+
+    if (listen_fd >= 0)
+        close(listen_fd);
+    delete cg;
+    delete csr;
+    delete g;
+    return 0;
+}
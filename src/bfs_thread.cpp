@@ -8,219 +8,381 @@
 #include <vector>
 #include <thread>
 #include <mutex>
-#include <condition_variable>
 #include <unistd.h>
 #include <algorithm>
-#include <unordered_set>
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <type_traits>
+#include <functional>
 
 #include "graph.cpp"
+#include "bitmap.cpp"
+#include "barrier.cpp"
+#include "arena.cpp"
+#include "work_deque.cpp"
+#include "cutoff.cpp"
+#include "prefetch.cpp"
+#include "balance.cpp"
+#include "bfs_engine.cpp"
+#include "bfs_policy.cpp"
+#include "numa.cpp"
+#include "simd.cpp"
+#include "value_index.cpp"
+#include "trace.cpp"
 #include "utimer.cpp"
 #include "utils.cpp"
+#include "query.cpp"
 #include "config.hpp"
 
 /**
- * @brief Class which implements a multiple workers with multiple generations barrier
+ * @brief A range of work on the frontier: the entries [first, last) or, for a hub node
+ *        split at edge granularity, the adjacencies [edge_first, edge_last) of the entry `first`
  */
-class Barrier
+struct WorkRange
 {
-public:
-    explicit Barrier(std::size_t i_count) : m_threshold(i_count),
-                                           m_count(i_count),
-                                           m_generation(0)
-    {
-    }
+    size_t first;
+    size_t last;
+    bool edges;
+    size_t edge_first;
+    size_t edge_last;
+};
 
-    /**
-     * @brief Puts the master on wait, waiting to be woken up by the workers
-     */
-    void MasterWait()
+/**
+ * @brief Per worker deque of frontier ranges: the owner pushes and pops at the back,
+ *        the thieves steal from the front, where the largest ranges are
+ */
+class alignas(64) StealingDeque
+{
+public:
+    void Push(const WorkRange &r)
     {
-        unique_lock<std::mutex> m_lock{m_mutex};
-        m_cond.wait(m_lock, [this]
-                    { return stop_master; });
-        stop_master = false;
+        lock_guard<std::mutex> lock{q_mutex};
+        q.push_back(r);
     }
 
-    /**
-     * @brief Starts the workers which should be on wait
-     */
-    void StartWorkers()
+    bool Pop(WorkRange &r)
     {
-        unique_lock<std::mutex> w_lock{w_mutex};
-        m_generation++;
-        w_cond.notify_all();
+        lock_guard<std::mutex> lock{q_mutex};
+        if (q.empty())
+            return false;
+        r = q.back();
+        q.pop_back();
+        return true;
     }
 
-    /**
-     * @brief Puts a worker on wait, if that worker is the last to be wake it wakes up
-     *        the master thread before putting himself on wait
-     */
-    void WorkerWait()
+    bool Steal(WorkRange &r)
     {
-        unique_lock<std::mutex> w_lock{w_mutex};
-        auto l_gen = m_generation;
-        if (!--m_count)
-        {
-            m_count = m_threshold;
-            stop_master = true;
-            m_cond.notify_one();
-        }
-        w_cond.wait(w_lock, [this, l_gen]
-                    { return l_gen != m_generation; }); /* needed to avoid spurious wakeups */ 
+        lock_guard<std::mutex> lock{q_mutex};
+        if (q.empty())
+            return false;
+        r = q.front();
+        q.pop_front();
+        return true;
     }
 
 private:
-    std::mutex w_mutex; /* the workers mutex */
-    std::mutex m_mutex; /* the master mutex */
-    std::condition_variable w_cond; /* the workers condition variable */
-    std::condition_variable m_cond; /* the master condition variable */
-    std::size_t m_threshold; /* the total number of workers */
-    std::size_t m_count; /* the current number of workers not in wait */
-    std::size_t m_generation; /* the current generation */
-    bool stop_master = false;
+    std::mutex q_mutex;
+    std::deque<WorkRange> q;
 };
 
 /**
- * @brief The BFS search using the plain C++.
+ * @brief The `LevelCutoff` of `parallel_bfs` on the graph `g` with the barrier B, as its
+ *        `cutoff` argument: measured once, before the searches on the same graph
+ */
+template <typename B = Barrier, typename G>
+long parallel_bfs_cutoff(const G *g, int n_workers)
+{
+    AtomicBitmap visited(g->n_nodes);
+    return LevelCutoff(
+               g, n_workers, [&]()
+               { return LevelCutoff::barrier_round_trip_ns<B>(n_workers); },
+               [&](uint val)
+               { return visited.test(val); })
+        .as_argument();
+}
+
+/**
+ * @brief The BFS search using the plain C++. A bounded `query` is checked by the master
+ *        at the end of each level, which stops the workers on `game_over`.
+ *        A level with less work than the `LevelCutoff` is expanded inline by the master,
+ *        as in `sequential_bfs`, and the workers are started by the first level which is
+ *        not: a search which never leaves the small levels does not start them at all.
+ *        With `prefetch_distance` > 0 the entries of a worker are expanded through the
+ *        prefetch pipeline of `for_each_prefetched`. With `edge_balance` the frontier is cut
+ *        by the master in one part of equal edges per worker (see `EdgeBalance`) in place of
+ *        the round robin chunks of entries, the hubs split among the workers.
  * 
+ * @tparam B the barrier between the levels (`Barrier` or `SpinBarrier`)
+ * @tparam Value the predicate on the values (`ValueEquals` or `ConstValueEquals<v>`)
+ * @tparam Chunk the chunk size compiled in, 0 for `chunk_size` (see `dispatch_parallel_bfs`)
+ * @tparam G the graph representation (`Graph` or `CSRGraph`)
  * @param g the Graph to which execute the search
  * @param start_node the starting node
  * @param search_value the value to search 
  * @param n_workers the number of workers
+ * @param chunk_size the number of frontier entries per chunk
+ * @param query when the search can stop, the whole component by default
+ * @param cutoff the least edges plus nodes of a level expanded by the workers, calibrated by the
+ *        search if negative (see `parallel_bfs_cutoff` to calibrate it once for many searches)
+ * @param edge_balance whether the levels are partitioned by edges rather than by entries
  * @return int the occurrences found
  */
-int parallel_bfs(Graph *g, int start_node, int search_value, int n_workers)
+template <typename B = Barrier, typename Value = ValueEquals, int Chunk = 0, typename G>
+int parallel_bfs(G *g, int start_node, int search_value, int n_workers, int chunk_size = CHUNK_SIZE,
+                 const BfsQuery &query = BfsQuery(), long cutoff = -1, bool edge_balance = false)
 {
+    const Value match(search_value);
+    /* both sized once on n_nodes, no allocation in the levels */
     vector<int> curr_frontier;
-    vector<vector<int>> partial_new_frontier(n_workers);
+    curr_frontier.reserve(g->n_nodes);
+    FrontierArena new_frontier(g->n_nodes, n_workers);
     vector<int> partial_results(n_workers);
     
-    Barrier *barrier = new Barrier(n_workers);
+    B *barrier = new B(n_workers);
 
-    vector<int> visited(g->n_nodes);
+    AtomicBitmap visited(g->n_nodes);
     bool game_over = false;
+    int depth = 0; /* the level being expanded, written by the master between two levels */
+    TRACE(BfsTrace trace("parallel_bfs", n_workers);)
+
+    LevelCutoff level_cutoff((cutoff > 0) ? cutoff : 0);
+    if (cutoff < 0)
+        level_cutoff = LevelCutoff(
+            g, n_workers, [&]()
+            { return LevelCutoff::barrier_round_trip_ns<B>(n_workers); },
+            [&](uint val)
+            { return visited.test(val); });
+    int inline_occurrences = 0; /* found by the master on the inline levels */
+    EdgeBalance balance;        /* of the current level, built by the master when `edge_balance` */
 
     /* worker routine, note the worker exits this function only when the BFS is over */
-    auto f = [&](int thread_no, int chunk_size)
+    auto f = [&](int thread_no, int run_chunk)
     {
+        const int chunk_size = (Chunk > 0) ? Chunk : run_chunk;
         int partial_occurrences = 0;
+        TRACE(perf_counters counters;)
         while (!game_over)
         {
+            TRACE(size_t level = depth; TraceThreadLevel &tl = trace.at(thread_no, level);
+                  perf_values p_busy = counters.read(); double t_busy = BfsTrace::now_us();)
+
             /* computing the current chunks indices */
             size_t curr_size = curr_frontier.size();
             int number_of_chunks = (curr_size / chunk_size);
             bool extra_chunk = ((thread_no == 0) && ((int)(curr_size % chunk_size) > 0)) ? true : false;
+            bool expand = query.expands(depth);
+            bool prefetch = (prefetch_distance > 0);
+            auto f_prefetch = [&](uint val)
+            { visited.prefetch(val); };
+            auto f_claim = [&](uint val)
+            {
+                if (visited.claim(val))
+                    new_frontier.push(thread_no, val);
+            };
 
             auto f_node = [&](auto curr_node)
             {
-                if (g->nodes[curr_node]->value == search_value)
+                if (match(g->get_value(curr_node)))
                     partial_occurrences++;
+                if (!expand)
+                    return;
 
-                for (auto &val : g->nodes[curr_node]->adj)
+                TRACE(tl.nodes++; tl.edges += g->get_degree(curr_node);)
+                if (prefetch)
+                    for_each_neighbor_prefetched(g->get_adj(curr_node), f_prefetch, f_claim);
+                else
                 {
-                    if (visited[val] == 0)
-                    {
-                        partial_new_frontier[thread_no].push_back(val);
-                        visited[val] = 1;
-                    }
+                    for (auto &val : g->get_adj(curr_node))
+                        f_claim(val);
                 }
             };
 
-            for (auto i = thread_no; i < number_of_chunks; i += n_workers)
+            if (edge_balance && expand)
             {
-                auto start = i * chunk_size;
-                auto stop = start + chunk_size;
-
-#ifdef DEBUG_PRINT
-                printf("th %d: [%d, %d)\n", thread_no, start, stop);
-#endif
-
-                for (int j = start; j < stop; j++)
+                /* the part of the worker, which may start or end inside an adjacency */
+                balance.for_each_in_part(
+                    g, [&](size_t j)
+                    { return (uint)curr_frontier[j]; },
+                    thread_no, n_workers,
+                    [&](uint curr_node)
+                    {
+                        if (match(g->get_value(curr_node)))
+                            partial_occurrences++;
+                        TRACE(tl.nodes++;)
+                    },
+                    [&](uint val)
+                    {
+                        TRACE(tl.edges++;)
+                        f_claim(val);
+                    });
+            }
+            else if (prefetch)
+            {
+                /* the entries of the worker in order: its chunks, then the extra one */
+                size_t own = (thread_no < number_of_chunks) ? (number_of_chunks - thread_no + n_workers - 1) / n_workers * chunk_size : 0;
+                size_t n = own + ((extra_chunk) ? curr_size - number_of_chunks * chunk_size : 0);
+                auto f_entry = [&](size_t t)
                 {
-                    auto curr_node = curr_frontier[j];
-#ifdef DEBUG_PRINT
-                    printf("Thread %d: taking %d\n", thread_no, curr_node);
-#endif
-                    f_node(curr_node);
-                }
+                    size_t j = (t < own) ? ((t / chunk_size) * n_workers + thread_no) * chunk_size + t % chunk_size
+                                         : number_of_chunks * chunk_size + (t - own);
+                    return (uint)curr_frontier[j];
+                };
+                for_each_prefetched(g, n, f_entry, f_prefetch, f_node);
             }
-
-            /* not even, there is an extra chunk to be computed */
-            if (extra_chunk)
+            else
             {
-                for (size_t i = number_of_chunks * chunk_size; i < curr_size; i++)
+                for (auto i = thread_no; i < number_of_chunks; i += n_workers)
                 {
-                    auto curr_node = curr_frontier[i];
-                    f_node(curr_node);
+                    auto start = i * chunk_size;
+                    auto stop = start + chunk_size;
+
+                    for (int j = start; j < stop; j++)
+                    {
+                        auto curr_node = curr_frontier[j];
+                        f_node(curr_node);
+                    }
+                }
+
+                /* not even, there is an extra chunk to be computed */
+                if (extra_chunk)
+                {
+                    for (size_t i = number_of_chunks * chunk_size; i < curr_size; i++)
+                    {
+                        auto curr_node = curr_frontier[i];
+                        f_node(curr_node);
+                    }
                 }
             }
 
-            /* job done, go on wait */
+            /* job done, go on wait, the partial result is read by the master between the levels */
+            partial_results[thread_no] = partial_occurrences;
+            TRACE(double t_wait = BfsTrace::now_us(); tl.busy_us = t_wait - t_busy; tl.perf = counters.read() - p_busy;)
             barrier->WorkerWait();
+            /* looked up again, `tl` may dangle: the master records its inline levels as worker 0 */
+            TRACE(trace.at(thread_no, level).wait_us = BfsTrace::now_us() - t_wait;)
         }
+    };
 
-        partial_results[thread_no] = partial_occurrences;
+    /* a small level expanded by the master, in the frontier part of the (idle) worker 0 */
+    auto f_inline = [&]()
+    {
+        bool expand = query.expands(depth);
+        TRACE(TraceThreadLevel &tl = trace.at(0, depth); double t_busy = BfsTrace::now_us();)
+        for (auto &curr_node : curr_frontier)
+        {
+            if (match(g->get_value(curr_node)))
+                inline_occurrences++;
+            if (!expand)
+                continue;
+
+            TRACE(tl.nodes++; tl.edges += g->get_degree(curr_node);)
+            for (auto &val : g->get_adj(curr_node))
+            {
+                if (visited.claim(val))
+                    new_frontier.push(0, val);
+            }
+        }
+        TRACE(tl.busy_us = BfsTrace::now_us() - t_busy;)
     };
 
     curr_frontier.push_back(start_node);
-    visited[start_node] = 1;
-    bool first_iteration = true;
-    vector<thread *> thread_ids(n_workers);
-    for (int i = 0; i < n_workers; i++)
-        thread_ids[i] = new thread(f, i, CHUNK_SIZE);
+    visited.set(start_node);
+    bool started = false;
+    vector<thread *> thread_ids;
 
-    unordered_set<int> merging_set;
     while (!curr_frontier.empty())
     {
-        if (!first_iteration) // already started
-            barrier->StartWorkers();
+        TRACE(size_t frontier_size = curr_frontier.size(); double t_level = BfsTrace::now_us();)
+        if (level_cutoff.sequential(curr_frontier.size(), [&](size_t j)
+                                    { return g->get_degree(curr_frontier[j]); }))
+            f_inline();
         else
-            first_iteration = false;
-
-        /* putting itself on wait */
-        barrier->MasterWait();
-        
-        /* merging phase */
-        for (size_t i = 0; i < partial_new_frontier.size(); i++)
         {
-            merging_set.insert(partial_new_frontier[i].begin(), partial_new_frontier[i].end());
-            partial_new_frontier[i].clear();
+            if (edge_balance)
+                balance.build(g, curr_frontier.size(), [&](size_t j)
+                              { return curr_frontier[j]; });
+            if (started)
+                barrier->StartWorkers();
+            else
+            {
+                /* the first parallel level, run by the workers as soon as they start */
+                for (int i = 0; i < n_workers; i++)
+                    thread_ids.push_back(new thread(f, i, chunk_size));
+                started = true;
+            }
+
+            /* putting itself on wait */
+            barrier->MasterWait();
         }
+        TRACE(double t_merge = BfsTrace::now_us();)
 
-        curr_frontier.assign(merging_set.begin(), merging_set.end());
+        if (query.bounded())
+        {
+            int matches = inline_occurrences;
+            for (auto &val : partial_results)
+                matches += val;
+            if (query.done(matches, depth))
+            {
+                TRACE(trace.add_level(frontier_size, t_merge - t_level, 0);)
+                break;
+            }
+        }
+        depth++;
+        
+        /* merging phase, the claims on `visited` make the partial frontiers disjoint */
+        curr_frontier.resize(new_frontier.seal());
+        new_frontier.copy_to(curr_frontier.data());
+        new_frontier.reset();
 
-        merging_set.clear();
         sort(curr_frontier.begin(), curr_frontier.end());
+        TRACE(trace.add_level(frontier_size, t_merge - t_level, BfsTrace::now_us() - t_merge);)
     }
 
     /* stopping the workers, and waking them up in case someone is on wait */ 
     game_over = 1;
-    barrier->StartWorkers();
+    if (started)
+        barrier->StartWorkers();
 
     /* local reduce */
-    int total_occurrences = 0;
-    for (int i = 0; i < n_workers; i++)
+    int total_occurrences = inline_occurrences;
+    for (size_t i = 0; i < thread_ids.size(); i++)
     {
         thread_ids[i]->join();
         total_occurrences += partial_results[i];
         delete thread_ids[i];
     }
+    TRACE(trace.print();)
 
     delete barrier;
 
-    return total_occurrences;
+    return query.result(total_occurrences);
+}
+
+/**
+ * @brief `parallel_bfs` with the value predicate and the chunk size compiled in when they
+ *        are instantiated (see `with_search_policy`), same parameters
+ */
+template <typename B = Barrier, typename G>
+int dispatch_parallel_bfs(G *g, int start_node, int search_value, int n_workers, int chunk_size = CHUNK_SIZE,
+                          const BfsQuery &query = BfsQuery(), long cutoff = -1, bool edge_balance = false)
+{
+    return with_search_policy(search_value, chunk_size, [&](auto value_tag, auto chunk)
+                              { return parallel_bfs<B, typename decltype(value_tag)::type, decltype(chunk)::value>(
+                                    g, start_node, search_value, n_workers, chunk_size, query, cutoff, edge_balance); });
 }
 
 // static partitioning version of the parallel BFS, used only for test
-int __parallel_bfs_static(Graph *g, int start_node, int search_value, int n_workers)
+template <typename B = Barrier, typename G>
+int __parallel_bfs_static(G *g, int start_node, int search_value, int n_workers)
 {
     vector<int> curr_frontier;
     vector<vector<int>> partial_new_frontier(n_workers);
     vector<int> partial_results(n_workers);
     bool game_over = false;
-    Barrier *barrier = new Barrier(n_workers);
+    B *barrier = new B(n_workers);
 
-    vector<int> d(g->n_nodes);
+    AtomicBitmap d(g->n_nodes);
 
     auto f = [&](int thread_no)
     {
@@ -239,28 +401,17 @@ int __parallel_bfs_static(Graph *g, int start_node, int search_value, int n_work
                 if (start == stop)
                     stop++;
 
-#ifdef DEBUG_PRINT
-                printf("th %d: [%d, %d) {%d, %d}\n", thread_no, start, stop, curr_size, delta);
-#endif
-
                 for (unsigned int i = start; i < stop; i++)
                 {
                     auto curr_node = curr_frontier[i];
 
-#ifdef DEBUG_PRINT
-                    printf("Thread %d: taking %d\n", thread_no, curr_node);
-#endif
-
-                    if (g->nodes[curr_node]->value == search_value)
+                    if (g->get_value(curr_node) == search_value)
                         partial_occurrences++;
 
-                    for (auto &val : g->nodes[curr_node]->adj)
+                    for (auto &val : g->get_adj(curr_node))
                     {
-                        if (d[val] == 0)
-                        {
+                        if (d.claim(val))
                             partial_new_frontier[thread_no].push_back(val);
-                            d[val] = 1;
-                        }
                     }
                 }
             }
@@ -272,13 +423,12 @@ int __parallel_bfs_static(Graph *g, int start_node, int search_value, int n_work
     };
 
     curr_frontier.push_back(start_node);
-    d[start_node] = 1;
+    d.set(start_node);
     int it = 0;
     vector<thread *> thread_ids(n_workers);
     for (int i = 0; i < n_workers; i++)
         thread_ids[i] = new thread(f, i);
 
-    unordered_set<int> merging_set;
     while (!curr_frontier.empty())
     {
         // split the frontier to the workers
@@ -289,14 +439,12 @@ int __parallel_bfs_static(Graph *g, int start_node, int search_value, int n_work
         barrier->MasterWait();
         // reduce the results
         it++;
+        curr_frontier.clear();
         for (size_t i = 0; i < partial_new_frontier.size(); i++)
         {
-            merging_set.insert(partial_new_frontier[i].begin(), partial_new_frontier[i].end());
+            curr_frontier.insert(curr_frontier.end(), partial_new_frontier[i].begin(), partial_new_frontier[i].end());
             partial_new_frontier[i].clear();
         }
-
-        curr_frontier.assign(merging_set.begin(), merging_set.end()); // si può cambiare come per sopra??
-        merging_set.clear();
     }
 
     game_over = 1;
@@ -315,40 +463,1170 @@ int __parallel_bfs_static(Graph *g, int start_node, int search_value, int n_work
     return total_occurrences;
 }
 
-#ifndef TEST_CPP
-int main(int argc, char *argv[])
+/**
+ * @brief The BFS search using the plain C++, without the serial merging phase between levels.
+ *        The workers claim the discovered nodes on the `visited` bitmap, so the
+ *        partial frontiers are disjoint and the next frontier is just their concatenation:
+ *        the workers read it in place, through the prefix sum of the partial sizes.
+ *        With `bitmap_frontier` the frontier is a bitmap instead, scanned in node order,
+ *        which gives the locality of the sorted frontier without sorting; every level costs
+ *        a scan of n_nodes / 64 words, so it pays off on large frontiers.
+ *        On a CSRGraph the vector kernels of simd.cpp count the values of each segment and
+ *        drop the visited neighbors before the atomic claims.
+ *
+ * @tparam B the barrier between the levels (`Barrier` or `SpinBarrier`)
+ * @tparam G the graph representation (`Graph` or `CSRGraph`)
+ * @param g the Graph to which execute the search
+ * @param start_node the starting node
+ * @param search_value the value to search
+ * @param n_workers the number of workers
+ * @param bitmap_frontier whether to use the bitmap frontier
+ * @param chunk_size the number of frontier entries (bitmap words) per chunk
+ * @return int the occurrences found
+ */
+template <typename B = Barrier, typename G>
+int parallel_bfs_nomerge(G *g, int start_node, int search_value, int n_workers, bool bitmap_frontier = false,
+                         int chunk_size = CHUNK_SIZE)
 {
-    if (argc < 3)
+    vector<vector<int>> curr_frontier(n_workers); /* one segment per worker of the previous level */
+    vector<vector<int>> partial_new_frontier(n_workers);
+    vector<size_t> frontier_offsets(n_workers + 1); /* prefix sum of the segment sizes */
+    AtomicBitmap *curr_bitmap = (bitmap_frontier) ? new AtomicBitmap(g->n_nodes) : NULL;
+    AtomicBitmap *new_bitmap = (bitmap_frontier) ? new AtomicBitmap(g->n_nodes) : NULL;
+    vector<size_t> partial_discovered(n_workers);
+    vector<int> partial_results(n_workers);
+
+    B *barrier = new B(n_workers);
+
+    AtomicBitmap visited(g->n_nodes);
+    bool game_over = false;
+
+    /* on the CSR the values of the frontier are counted and the neighbors filtered by the vector kernels */
+    constexpr bool vector_kernels = std::is_same<G, CSRGraph>::value;
+
+    auto f = [&](int thread_no, int chunk_size)
     {
-        printf("Usage: %s n_nodes n_threads --start [start_node] --search [search_value] \
-        --max [max_value] --seed [seed_value]\n",
-               argv[0]);
-        exit(-1);
+        int partial_occurrences = 0;
+        uint candidates[simd_block + simd_slack];
+        while (!game_over)
+        {
+            size_t discovered = 0;
+
+            auto f_claimed = [&](uint val)
+            {
+                if (bitmap_frontier)
+                    new_bitmap->set(val);
+                else
+                    partial_new_frontier[thread_no].push_back(val);
+                discovered++;
+            };
+
+            auto f_node = [&](uint curr_node)
+            {
+                if ((!vector_kernels || bitmap_frontier) && g->get_value(curr_node) == search_value)
+                    partial_occurrences++;
+
+                if constexpr (vector_kernels)
+                {
+                    /* the neighbors seen visited are dropped a block at a time, the others are claimed */
+                    auto adj = g->get_adj(curr_node);
+                    for (const uint *block = adj.begin(); block < adj.end(); block += simd_block)
+                    {
+                        size_t n = simd.filter_unvisited(block, min<size_t>(simd_block, adj.end() - block),
+                                                         visited.raw_words32(), candidates);
+                        for (size_t k = 0; k < n; k++)
+                            if (visited.set(candidates[k]))
+                                f_claimed(candidates[k]);
+                    }
+                }
+                else
+                {
+                    for (auto &val : g->get_adj(curr_node))
+                    {
+                        if (visited.claim(val))
+                            f_claimed(val);
+                    }
+                }
+            };
+
+            if (bitmap_frontier)
+            {
+                /* chunks of words round robin, a word is cleared once scanned, ready for the next level */
+                size_t n_words = curr_bitmap->n_words;
+                for (size_t start = thread_no * chunk_size; start < n_words; start += (size_t)n_workers * chunk_size)
+                {
+                    size_t stop = min(start + chunk_size, n_words);
+                    for (size_t w = start; w < stop; w++)
+                    {
+                        curr_bitmap->for_each_in_word(w, f_node);
+                        curr_bitmap->clear_word(w);
+                    }
+                }
+            }
+            else
+            {
+                /* each worker counts the values of the segment it discovered, at once */
+                if constexpr (vector_kernels)
+                    partial_occurrences += simd.count_values(g->values, g->n_nodes, curr_frontier[thread_no].data(),
+                                                             curr_frontier[thread_no].size(), search_value);
+
+                /* chunks round robin as in `parallel_bfs`, over the concatenation of the segments */
+                size_t curr_size = frontier_offsets[n_workers];
+                size_t seg = 0;
+                for (size_t start = thread_no * chunk_size; start < curr_size; start += (size_t)n_workers * chunk_size)
+                {
+                    size_t stop = min(start + chunk_size, curr_size);
+                    for (size_t j = start; j < stop; j++)
+                    {
+                        while (frontier_offsets[seg + 1] <= j)
+                            seg++;
+                        f_node(curr_frontier[seg][j - frontier_offsets[seg]]);
+                    }
+                }
+            }
+
+            partial_discovered[thread_no] = discovered;
+            barrier->WorkerWait();
+        }
+
+        partial_results[thread_no] = partial_occurrences;
+    };
+
+    visited.set(start_node);
+    if (bitmap_frontier)
+        curr_bitmap->set(start_node);
+    else
+        curr_frontier[0].push_back(start_node);
+    for (int i = 0; i < n_workers; i++)
+        frontier_offsets[i + 1] = frontier_offsets[i] + curr_frontier[i].size();
+
+    vector<thread *> thread_ids(n_workers);
+    for (int i = 0; i < n_workers; i++)
+        thread_ids[i] = new thread(f, i, chunk_size);
+
+    bool first_iteration = true;
+    size_t curr_size = 1;
+    while (curr_size > 0)
+    {
+        if (!first_iteration)
+            barrier->StartWorkers();
+        else
+            first_iteration = false;
+
+        barrier->MasterWait();
+
+        /* no merging: the partial frontiers become the segments of the new one */
+        curr_size = 0;
+        for (int i = 0; i < n_workers; i++)
+            curr_size += partial_discovered[i];
+
+        if (bitmap_frontier)
+            swap(curr_bitmap, new_bitmap);
+        else
+        {
+            swap(curr_frontier, partial_new_frontier);
+            for (int i = 0; i < n_workers; i++)
+            {
+                partial_new_frontier[i].clear();
+                frontier_offsets[i + 1] = frontier_offsets[i] + curr_frontier[i].size();
+            }
+        }
     }
-    int n_nodes = atoi(argv[1]);
-    int n_workers = atoi(argv[2]);
 
-    int start_node = (cmdOptionExists(argv, argv + argc, "--start")) ? atoi(getCmdOption(argv, argv + argc, "--start"))
-                                                                     : default_start_node;
-    int search_value = (cmdOptionExists(argv, argv + argc, "--search")) ? atoi(getCmdOption(argv, argv + argc, "--search"))
-                                                                        : default_search_value;
-    int max = (cmdOptionExists(argv, argv + argc, "--max")) ? atoi(getCmdOption(argv, argv + argc, "--max"))
-                                                            : default_max_value;
-    int seed = (cmdOptionExists(argv, argv + argc, "--seed")) ? atoi(getCmdOption(argv, argv + argc, "--seed"))
-                                                              : default_seed_value;
-    int percent = (cmdOptionExists(argv, argv + argc, "--percent")) ? atoi(getCmdOption(argv, argv + argc, "--percent"))
-                                                              : default_percent_value;
+    game_over = 1;
+    barrier->StartWorkers();
 
-    Graph *g = Graph::generate_graph(n_nodes, seed, max, percent);
-    int occ = -1;
+    int total_occurrences = 0;
+    for (int i = 0; i < n_workers; i++)
+    {
+        thread_ids[i]->join();
+        total_occurrences += partial_results[i];
+        delete thread_ids[i];
+    }
+
+    delete barrier;
+    delete curr_bitmap;
+    delete new_bitmap;
+
+    return total_occurrences;
+}
+
+/**
+ * @brief The BFS search using the plain C++ with work stealing. At each level every worker
+ *        gets a contiguous slice of the frontier in its deque and splits it lazily: it keeps
+ *        halving the popped range, pushing back the upper half, down to `chunk_size` entries.
+ *        An idle worker steals from the others until no range is left in the whole level.
+ *        With `split_degree` > 0 the adjacency of a node with a higher degree is split in the
+ *        same way, so a single hub can be expanded by several workers.
+ *
+ * @tparam B the barrier between the levels (`Barrier` or `SpinBarrier`)
+ * @tparam G the graph representation (`Graph` or `CSRGraph`)
+ * @param g the Graph to which execute the search
+ * @param start_node the starting node
+ * @param search_value the value to search
+ * @param n_workers the number of workers
+ * @param chunk_size the smallest range of frontier entries which is split
+ * @param split_degree the smallest degree of a node split at edge granularity, 0 to disable
+ * @return int the occurrences found
+ */
+template <typename B = Barrier, typename G>
+int parallel_bfs_steal(G *g, int start_node, int search_value, int n_workers,
+                       size_t chunk_size = default_steal_chunk, size_t split_degree = 0)
+{
+    vector<int> curr_frontier;
+    vector<vector<int>> partial_new_frontier(n_workers);
+    vector<int> partial_results(n_workers);
+    vector<StealingDeque> deques(n_workers);
+    atomic<size_t> pending_ranges(0); /* ranges pushed and not completed yet in this level */
+
+    B *barrier = new B(n_workers);
+
+    AtomicBitmap visited(g->n_nodes);
+    bool game_over = false;
+
+    auto f = [&](int thread_no)
+    {
+        int partial_occurrences = 0;
+
+        /* expands the adjacencies [eb, ee) of the node, a compressed list is decoded up to eb */
+        auto f_edges = [&](int curr_node, size_t eb, size_t ee)
+        {
+            const auto &adj = g->get_adj(curr_node);
+            auto it = std::next(adj.begin(), eb);
+            for (size_t e = eb; e < ee; e++, ++it)
+            {
+                if (visited.claim(*it))
+                    partial_new_frontier[thread_no].push_back(*it);
+            }
+        };
+
+        auto f_range = [&](WorkRange r)
+        {
+            if (r.edges)
+            {
+                while (r.edge_last - r.edge_first > split_degree)
+                {
+                    size_t mid = r.edge_first + (r.edge_last - r.edge_first) / 2;
+                    pending_ranges++;
+                    deques[thread_no].Push({r.first, r.last, true, mid, r.edge_last});
+                    r.edge_last = mid;
+                }
+                f_edges(curr_frontier[r.first], r.edge_first, r.edge_last);
+                return;
+            }
+
+            while (r.last - r.first > chunk_size)
+            {
+                size_t mid = r.first + (r.last - r.first) / 2;
+                pending_ranges++;
+                deques[thread_no].Push({mid, r.last, false, 0, 0});
+                r.last = mid;
+            }
+
+            for (size_t j = r.first; j < r.last; j++)
+            {
+                auto curr_node = curr_frontier[j];
+                if (g->get_value(curr_node) == search_value)
+                    partial_occurrences++;
+
+                size_t degree = g->get_degree(curr_node);
+                if (split_degree > 0 && degree > split_degree)
+                {
+                    pending_ranges++;
+                    deques[thread_no].Push({j, j + 1, true, 0, degree});
+                }
+                else
+                    f_edges(curr_node, 0, degree);
+            }
+        };
+
+        while (!game_over)
+        {
+            WorkRange r;
+            while (pending_ranges.load() > 0)
+            {
+                bool found = deques[thread_no].Pop(r);
+                for (int k = 1; !found && k < n_workers; k++)
+                    found = deques[(thread_no + k) % n_workers].Steal(r);
+
+                if (!found)
+                {
+                    this_thread::yield();
+                    continue;
+                }
+
+                f_range(r);
+                pending_ranges--;
+            }
+
+            barrier->WorkerWait();
+        }
+
+        partial_results[thread_no] = partial_occurrences;
+    };
+
+    /* gives each worker its contiguous slice of the frontier */
+    auto distribute = [&]()
     {
+        size_t curr_size = curr_frontier.size();
+        size_t delta = (curr_size + n_workers - 1) / n_workers;
+        for (int i = 0; i < n_workers; i++)
+        {
+            size_t first = min(i * delta, curr_size);
+            size_t last = min(first + delta, curr_size);
+            if (first < last)
+            {
+                pending_ranges++;
+                deques[i].Push({first, last, false, 0, 0});
+            }
+        }
+    };
+
+    curr_frontier.push_back(start_node);
+    visited.set(start_node);
+    distribute();
+
+    vector<thread *> thread_ids(n_workers);
+    for (int i = 0; i < n_workers; i++)
+        thread_ids[i] = new thread(f, i);
+
+    bool first_iteration = true;
+    while (!curr_frontier.empty())
+    {
+        if (!first_iteration)
+            barrier->StartWorkers();
+        else
+            first_iteration = false;
+
+        barrier->MasterWait();
+
+        curr_frontier.clear();
+        for (auto &partial : partial_new_frontier)
+        {
+            curr_frontier.insert(curr_frontier.end(), partial.begin(), partial.end());
+            partial.clear();
+        }
+        sort(curr_frontier.begin(), curr_frontier.end());
+        distribute();
+    }
+
+    game_over = 1;
+    barrier->StartWorkers();
+
+    int total_occurrences = 0;
+    for (int i = 0; i < n_workers; i++)
+    {
+        thread_ids[i]->join();
+        total_occurrences += partial_results[i];
+        delete thread_ids[i];
+    }
+
+    delete barrier;
+
+    return total_occurrences;
+}
+
+/**
+ * @brief The BFS search without levels: the occurrences do not depend on the order of the
+ *        visit, so the nodes are expanded as soon as they are claimed, with no barrier and
+ *        no frontier merge. A worker pushes the nodes it claims on its own `ChaseLevDeque`
+ *        and pops them back (depth first), an idle worker steals from the top of the others.
+ *        The search ends at quiescence: `pending` counts the claimed nodes not expanded
+ *        yet, and a node adds its claimed neighbors before pushing them, so it reaches 0
+ *        only when no node is left in any deque nor being expanded.
+ *
+ * @tparam G the graph representation (`Graph` or `CSRGraph`)
+ * @param g the Graph to which execute the search
+ * @param start_node the starting node
+ * @param search_value the value to search
+ * @param n_workers the number of workers
+ * @return int the occurrences found
+ */
+template <typename G>
+int async_bfs(G *g, int start_node, int search_value, int n_workers)
+{
+    vector<ChaseLevDeque> deques(n_workers);
+    vector<int> partial_results(n_workers);
+    atomic<long> pending(1); /* the start node */
+
+    AtomicBitmap visited(g->n_nodes);
+
+    auto f = [&](int thread_no)
+    {
+        int partial_occurrences = 0;
+        vector<uint> claimed;
+        uint curr_node;
+
+        while (true)
+        {
+            bool found = deques[thread_no].pop(curr_node);
+            for (int k = 1; !found && k < n_workers; k++)
+                found = deques[(thread_no + k) % n_workers].steal(curr_node);
+
+            if (!found)
+            {
+                if (pending.load(std::memory_order_acquire) == 0)
+                    break;
+                this_thread::yield();
+                continue;
+            }
+
+            if (g->get_value(curr_node) == search_value)
+                partial_occurrences++;
+
+            for (auto &val : g->get_adj(curr_node))
+                if (visited.claim(val))
+                    claimed.push_back(val);
+
+            /* the expanded node is replaced by its claimed neighbors, one update per node */
+            if (claimed.size() != 1)
+                pending.fetch_add((long)claimed.size() - 1, std::memory_order_acq_rel);
+            for (auto &val : claimed)
+                deques[thread_no].push(val);
+            claimed.clear();
+        }
+
+        partial_results[thread_no] = partial_occurrences;
+    };
+
+    visited.set(start_node);
+    deques[0].push(start_node);
+
+    vector<thread *> thread_ids(n_workers);
+    for (int i = 0; i < n_workers; i++)
+        thread_ids[i] = new thread(f, i);
+
+    int total_occurrences = 0;
+    for (int i = 0; i < n_workers; i++)
+    {
+        thread_ids[i]->join();
+        total_occurrences += partial_results[i];
+        delete thread_ids[i];
+    }
+
+    return total_occurrences;
+}
+
+/**
+ * @brief The direction-optimizing BFS search (top-down/bottom-up hybrid) using the plain C++.
+ *        Each level is expanded either top-down, as in `parallel_bfs`, or bottom-up: every
+ *        unvisited node looks through its incoming adjacencies for a parent in the frontier
+ *        and stops at the first one found. It switches to bottom-up when the frontier edges
+ *        exceed the unexplored edges / alpha, and back to top-down when the frontier shrinks
+ *        below n_nodes / beta.
+ *
+ * @tparam B the barrier between the levels (`Barrier` or `SpinBarrier`)
+ * @tparam G the graph representation (`Graph` or `CSRGraph`)
+ * @param g the Graph to which execute the search
+ * @param rg the reverse graph of `g`, see `transpose_graph`
+ * @param start_node the starting node
+ * @param search_value the value to search
+ * @param n_workers the number of workers
+ * @param alpha the top-down to bottom-up threshold
+ * @param beta the bottom-up to top-down threshold
+ * @return int the occurrences found
+ */
+template <typename B = Barrier, typename G>
+int hybrid_bfs(G *g, const CSRGraph *rg, int start_node, int search_value, int n_workers,
+               int alpha = default_hybrid_alpha, int beta = default_hybrid_beta)
+{
+    const size_t bottom_up_chunk = 256; /* nodes scanned per bottom-up chunk */
+
+    vector<int> curr_frontier;
+    vector<vector<int>> partial_new_frontier(n_workers);
+    vector<int> partial_results(n_workers);
+
+    B *barrier = new B(n_workers);
+
+    AtomicBitmap visited(g->n_nodes);
+    AtomicBitmap frontier_bits(g->n_nodes); /* the current frontier, filled only for the bottom-up levels */
+    bool bottom_up = false;
+    bool game_over = false;
+
+    /* worker routine, as in `parallel_bfs` the worker exits only when the BFS is over */
+    auto f = [&](int thread_no, int chunk_size)
+    {
+        int partial_occurrences = 0;
+        while (!game_over)
+        {
+            /* the frontier chunks are taken round robin, in top-down they are also expanded */
+            size_t curr_size = curr_frontier.size();
+            for (size_t start = thread_no * chunk_size; start < curr_size; start += (size_t)n_workers * chunk_size)
+            {
+                size_t stop = min(start + chunk_size, curr_size);
+                for (size_t j = start; j < stop; j++)
+                {
+                    auto curr_node = curr_frontier[j];
+                    if (g->get_value(curr_node) == search_value)
+                        partial_occurrences++;
+
+                    if (bottom_up)
+                        continue;
+
+                    for (auto &val : g->get_adj(curr_node))
+                    {
+                        if (visited.claim(val))
+                            partial_new_frontier[thread_no].push_back(val);
+                    }
+                }
+            }
+
+            /* each worker owns the nodes of its chunks, so no claim is needed */
+            if (bottom_up)
+            {
+                for (size_t start = thread_no * bottom_up_chunk; start < g->n_nodes; start += n_workers * bottom_up_chunk)
+                {
+                    size_t stop = min(start + bottom_up_chunk, (size_t)g->n_nodes);
+                    for (size_t v = start; v < stop; v++)
+                    {
+                        if (visited.test(v))
+                            continue;
+
+                        for (auto &parent : rg->get_adj(v))
+                        {
+                            if (frontier_bits.test(parent))
+                            {
+                                partial_new_frontier[thread_no].push_back(v);
+                                visited.set(v);
+                                break;
+                            }
+                        }
+                    }
+                }
+            }
+
+            barrier->WorkerWait();
+        }
+
+        partial_results[thread_no] = partial_occurrences;
+    };
+
+    curr_frontier.push_back(start_node);
+    visited.set(start_node);
+
+    eid_t frontier_edges = g->get_degree(start_node);
+    eid_t unexplored_edges = rg->n_edges - rg->get_degree(start_node);
+    size_t prev_size = 0;
+
+    /* chooses the direction of the next level, a bottom-up level needs the frontier as bitmap */
+    auto choose_direction = [&]()
+    {
+        size_t curr_size = curr_frontier.size();
+        if (!bottom_up && frontier_edges > unexplored_edges / alpha)
+            bottom_up = true;
+        else if (bottom_up && curr_size < g->n_nodes / beta && curr_size < prev_size)
+            bottom_up = false;
+        prev_size = curr_size;
+
+        if (bottom_up)
+        {
+            frontier_bits.clear();
+            for (auto &v : curr_frontier)
+                frontier_bits.set(v);
+        }
+    };
+
+    choose_direction();
+
+    vector<thread *> thread_ids(n_workers);
+    for (int i = 0; i < n_workers; i++)
+        thread_ids[i] = new thread(f, i, CHUNK_SIZE);
+
+    bool first_iteration = true;
+    while (!curr_frontier.empty())
+    {
+        if (!first_iteration)
+            barrier->StartWorkers();
+        else
+            first_iteration = false;
+
+        barrier->MasterWait();
+
+        /* merging phase, the partial frontiers are disjoint in both directions */
+        curr_frontier.clear();
+        for (auto &partial : partial_new_frontier)
+        {
+            curr_frontier.insert(curr_frontier.end(), partial.begin(), partial.end());
+            partial.clear();
+        }
+        sort(curr_frontier.begin(), curr_frontier.end());
+
+        frontier_edges = 0;
+        for (auto &v : curr_frontier)
+        {
+            frontier_edges += g->get_degree(v);
+            unexplored_edges -= rg->get_degree(v);
+        }
+        choose_direction();
+    }
+
+    game_over = 1;
+    barrier->StartWorkers();
+
+    int total_occurrences = 0;
+    for (int i = 0; i < n_workers; i++)
+    {
+        thread_ids[i]->join();
+        total_occurrences += partial_results[i];
+        delete thread_ids[i];
+    }
+
+    delete barrier;
+
+    return total_occurrences;
+}
+
+/**
+ * @brief The multi-source BFS (see `multi_source_bfs`) using the plain C++. Every level has
+ *        two phases separated by the barrier: the workers first expand their chunks of the
+ *        frontier, or-ing the masks of the new searches into `visit_next` (the first worker
+ *        to touch a node takes it in its partial frontier); then each one updates `seen` and
+ *        the counts of the nodes it took, which no other worker touches.
+ *
+ * @tparam B the barrier between the levels (`Barrier` or `SpinBarrier`)
+ * @tparam G the graph representation (`Graph` or `CSRGraph`)
+ * @param g the Graph to which execute the search
+ * @param start_nodes the starting node of each search
+ * @param search_values the value to search of each search
+ * @param n_workers the number of workers
+ * @return vector<int> the number of occurrences found by each search
+ */
+template <typename B = Barrier, typename G>
+vector<int> parallel_multi_source_bfs(G *g, const vector<int> &start_nodes, const vector<int> &search_values, int n_workers)
+{
+    const size_t batch_size = 64;
+    vector<int> occ(start_nodes.size());
+
+    vector<int> curr_frontier;
+    vector<vector<int>> partial_new_frontier(n_workers);
+    vector<vector<int>> partial_results(n_workers, vector<int>(batch_size));
+
+    unique_ptr<uint64_t[]> seen(new uint64_t[g->n_nodes]());
+    unique_ptr<atomic<uint64_t>[]> visit(new atomic<uint64_t>[g->n_nodes]);
+    unique_ptr<atomic<uint64_t>[]> visit_next(new atomic<uint64_t>[g->n_nodes]);
+    for (uint i = 0; i < g->n_nodes; i++)
+    {
+        visit[i].store(0, memory_order_relaxed);
+        visit_next[i].store(0, memory_order_relaxed);
+    }
+
+    size_t first = 0; /* the first search of the current batch */
+    bool expand_phase = true;
+    bool game_over = false;
+
+    B *barrier = new B(n_workers);
+
+    auto f = [&](int thread_no, int chunk_size)
+    {
+        while (true)
+        {
+            barrier->WorkerWait();
+            if (game_over)
+                break;
+
+            size_t curr_size = curr_frontier.size();
+            if (expand_phase)
+            {
+                for (size_t start = thread_no * chunk_size; start < curr_size; start += (size_t)n_workers * chunk_size)
+                {
+                    size_t stop = min(start + chunk_size, curr_size);
+                    for (size_t j = start; j < stop; j++)
+                    {
+                        int curr = curr_frontier[j];
+                        uint64_t mask = visit[curr].load(memory_order_relaxed);
+                        for (auto &val : g->get_adj(curr))
+                        {
+                            uint64_t d = mask & ~seen[val];
+                            if (d && (visit_next[val].load(memory_order_relaxed) & d) != d &&
+                                visit_next[val].fetch_or(d, memory_order_relaxed) == 0)
+                                partial_new_frontier[thread_no].push_back(val);
+                        }
+                    }
+                }
+                continue;
+            }
+
+            /* update phase: the frontier of this level is no longer needed */
+            for (size_t start = thread_no * chunk_size; start < curr_size; start += (size_t)n_workers * chunk_size)
+            {
+                size_t stop = min(start + chunk_size, curr_size);
+                for (size_t j = start; j < stop; j++)
+                    visit[curr_frontier[j]].store(0, memory_order_relaxed);
+            }
+
+            for (auto &val : partial_new_frontier[thread_no])
+            {
+                uint64_t mask = visit_next[val].load(memory_order_relaxed);
+                seen[val] |= mask;
+                while (mask)
+                {
+                    int b = __builtin_ctzll(mask);
+                    if (g->get_value(val) == search_values[first + b])
+                        partial_results[thread_no][b]++;
+                    mask &= mask - 1;
+                }
+            }
+        }
+    };
+
+    vector<thread *> thread_ids(n_workers);
+    for (int i = 0; i < n_workers; i++)
+        thread_ids[i] = new thread(f, i, CHUNK_SIZE);
+    barrier->MasterWait();
+
+    for (; first < start_nodes.size(); first += batch_size)
+    {
+        size_t n_sources = min(batch_size, start_nodes.size() - first);
+
+        curr_frontier.clear();
+        for (size_t b = 0; b < n_sources; b++)
+        {
+            int s = start_nodes[first + b];
+            if (visit[s].load(memory_order_relaxed) == 0)
+                curr_frontier.push_back(s);
+            visit[s].fetch_or((uint64_t)1 << b, memory_order_relaxed);
+            seen[s] |= (uint64_t)1 << b;
+            if (g->get_value(s) == search_values[first + b])
+                occ[first + b]++;
+        }
+
+        while (!curr_frontier.empty())
+        {
+            expand_phase = true;
+            barrier->StartWorkers();
+            barrier->MasterWait();
+
+            expand_phase = false;
+            barrier->StartWorkers();
+            barrier->MasterWait();
+
+            swap(visit, visit_next);
+            curr_frontier.clear();
+            for (auto &partial : partial_new_frontier)
+            {
+                curr_frontier.insert(curr_frontier.end(), partial.begin(), partial.end());
+                partial.clear();
+            }
+        }
+
+        /* local reduce of the batch */
+        for (int i = 0; i < n_workers; i++)
+        {
+            for (size_t b = 0; b < n_sources; b++)
+                occ[first + b] += partial_results[i][b];
+            fill(partial_results[i].begin(), partial_results[i].end(), 0);
+        }
+        fill(seen.get(), seen.get() + g->n_nodes, 0);
+    }
+
+    game_over = true;
+    barrier->StartWorkers();
+    for (int i = 0; i < n_workers; i++)
+    {
+        thread_ids[i]->join();
+        delete thread_ids[i];
+    }
+
+    delete barrier;
+
+    return occ;
+}
+
+/**
+ * @brief The multi-source BFS using the plain C++, with the same value to search for every start node
+ */
+template <typename B = Barrier, typename G>
+vector<int> parallel_multi_source_bfs(G *g, const vector<int> &start_nodes, int search_value, int n_workers)
+{
+    return parallel_multi_source_bfs<B>(g, start_nodes, vector<int>(start_nodes.size(), search_value), n_workers);
+}
+
+/**
+ * @brief The BFS search using the plain C++ on a NUMA layout. The workers are pinned on
+ *        their sockets and clear their part of the `visited` bitmap, so it is placed as the
+ *        graph of `numa_place`. A newly claimed node is routed to the socket owning it: the
+ *        partial frontiers are split by destination socket, and the workers of a socket expand
+ *        only the nodes it owns, reading their values and adjacencies from local memory.
+ *        Within a socket the frontier is read in chunks round robin, as in `parallel_bfs_nomerge`.
+ *
+ * @tparam B the barrier between the levels (`Barrier` or `SpinBarrier`)
+ * @tparam G the graph representation (`Graph` or `CSRGraph`), placed by `numa_place`
+ * @param g the Graph to which execute the search
+ * @param layout the NUMA layout of the workers and of the nodes
+ * @param start_node the starting node
+ * @param search_value the value to search
+ * @param per_core whether to pin each worker to one cpu instead of to its whole socket
+ * @param chunk_size the number of frontier entries per chunk
+ * @return int the occurrences found
+ */
+template <typename B = Barrier, typename G>
+int numa_bfs(G *g, const NumaLayout &layout, int start_node, int search_value, bool per_core = true,
+             int chunk_size = CHUNK_SIZE)
+{
+    int n_workers = layout.n_workers;
+    int n_sockets = layout.n_sockets;
+
+    /* curr_frontier[w][s]: the nodes owned by the socket s claimed by the worker w in the previous level */
+    vector<vector<vector<int>>> curr_frontier(n_workers, vector<vector<int>>(n_sockets));
+    vector<vector<vector<int>>> partial_new_frontier(n_workers, vector<vector<int>>(n_sockets));
+    vector<vector<size_t>> frontier_offsets(n_sockets, vector<size_t>(n_workers + 1)); /* per socket, over the workers */
+    vector<int> partial_results(n_workers);
+
+    B *barrier = new B(n_workers);
+
+    AtomicBitmap visited(g->n_nodes, false); /* cleared by the workers, on their sockets */
+    bool game_over = false;
+
+    auto f = [&](int thread_no, int chunk_size)
+    {
+        layout.pin(thread_no, per_core);
+
+        uint first, last;
+        layout.worker_range(thread_no, &first, &last);
+        visited.clear(first / 64, (last + 63) / 64);
+        barrier->WorkerWait();
+
+        int socket = layout.socket_of_worker[thread_no];
+        int rank = layout.rank_in_socket[thread_no];
+        int socket_workers = layout.workers_in_socket[socket];
+        const vector<size_t> &offsets = frontier_offsets[socket];
+
+        int partial_occurrences = 0;
+        while (!game_over)
+        {
+            size_t curr_size = offsets[n_workers];
+            size_t seg = 0;
+            for (size_t start = rank * chunk_size; start < curr_size; start += (size_t)socket_workers * chunk_size)
+            {
+                size_t stop = min(start + chunk_size, curr_size);
+                for (size_t j = start; j < stop; j++)
+                {
+                    while (offsets[seg + 1] <= j)
+                        seg++;
+                    int curr_node = curr_frontier[seg][socket][j - offsets[seg]];
+
+                    if (g->get_value(curr_node) == search_value)
+                        partial_occurrences++;
+
+                    for (auto &val : g->get_adj(curr_node))
+                    {
+                        if (visited.claim(val))
+                            partial_new_frontier[thread_no][layout.owner(val)].push_back(val);
+                    }
+                }
+            }
+
+            barrier->WorkerWait();
+        }
+
+        partial_results[thread_no] = partial_occurrences;
+    };
+
+    vector<thread *> thread_ids(n_workers);
+    for (int i = 0; i < n_workers; i++)
+        thread_ids[i] = new thread(f, i, chunk_size);
+
+    /* waiting the workers to clear `visited` */
+    barrier->MasterWait();
+
+    visited.set(start_node);
+    curr_frontier[0][layout.owner(start_node)].push_back(start_node);
+    size_t curr_size = 1;
+    while (curr_size > 0)
+    {
+        curr_size = 0;
+        for (int s = 0; s < n_sockets; s++)
+        {
+            for (int i = 0; i < n_workers; i++)
+                frontier_offsets[s][i + 1] = frontier_offsets[s][i] + curr_frontier[i][s].size();
+            curr_size += frontier_offsets[s][n_workers];
+        }
+        if (curr_size == 0)
+            break;
+
+        barrier->StartWorkers();
+        barrier->MasterWait();
+
+        /* no merging: the partial frontiers become the segments of the new one */
+        swap(curr_frontier, partial_new_frontier);
+        for (int i = 0; i < n_workers; i++)
+            for (int s = 0; s < n_sockets; s++)
+                partial_new_frontier[i][s].clear();
+    }
+
+    game_over = 1;
+    barrier->StartWorkers();
+
+    int total_occurrences = 0;
+    for (int i = 0; i < n_workers; i++)
+    {
+        thread_ids[i]->join();
+        total_occurrences += partial_results[i];
+        delete thread_ids[i];
+    }
+
+    delete barrier;
+
+    return total_occurrences;
+}
+
+#ifndef TEST_CPP
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        printf("Usage: %s n_nodes n_threads --start [start_node] --search [search_value] \
+        --max [max_value] --seed [seed_value] --percent [percent_value] [--csr] \
+        [--graph graph_file] [--edges edge_list] [--ingest n_threads] [--save graph_file] [--pgen n_threads] [--undirected] [--reorder rcm|degree|bfs] [--mode rr|static|hybrid|nomerge|bitmap|steal|async|engine|numa|policy|index] \
+        [--split hub_degree] [--barrier cond|spin] [--spin spin_budget] [--repeat n_searches] \
+        [--sources start_node,...] [--pin cores|sockets] [--simd scalar|avx2|avx512] \
+        [--visited bitmap|bytes] [--frontier queue|bitmap] [--chunk chunk_size] \
+        [--exists] [--top k] [--depth max_depth] [--compress] [--cutoff level_work] [--prefetch distance] \
+        [--balance nodes|edges]\n",
+               argv[0]);
+        exit(-1);
+    }
+    int n_nodes = atoi(argv[1]);
+    int n_workers = atoi(argv[2]);
+
+    int start_node = (cmdOptionExists(argv, argv + argc, "--start")) ? atoi(getCmdOption(argv, argv + argc, "--start"))
+                                                                     : default_start_node;
+    int search_value = (cmdOptionExists(argv, argv + argc, "--search")) ? atoi(getCmdOption(argv, argv + argc, "--search"))
+                                                                        : default_search_value;
+    int max = (cmdOptionExists(argv, argv + argc, "--max")) ? atoi(getCmdOption(argv, argv + argc, "--max"))
+                                                            : default_max_value;
+    int seed = (cmdOptionExists(argv, argv + argc, "--seed")) ? atoi(getCmdOption(argv, argv + argc, "--seed"))
+                                                              : default_seed_value;
+    int percent = (cmdOptionExists(argv, argv + argc, "--percent")) ? atoi(getCmdOption(argv, argv + argc, "--percent"))
+                                                              : default_percent_value;
+
+    Graph *g;
+    CSRGraph *csr;
+    if (!setup_graph(argc, argv, n_nodes, seed, max, percent, &g, &csr))
+        exit(-1);
+    bool use_csr = (csr != NULL);
+
+    /* the start nodes are original ids, also on a relabeled graph */
+    if (use_csr)
+        start_node = csr->node_id(start_node);
+
+    string mode = (cmdOptionExists(argv, argv + argc, "--mode")) ? getCmdOption(argv, argv + argc, "--mode")
+                                                                 : "rr";
+    if (mode != "rr" && mode != "static" && mode != "hybrid" && mode != "nomerge" && mode != "bitmap" &&
+        mode != "steal" && mode != "async" && mode != "engine" && mode != "numa" && mode != "policy" && mode != "index")
+    {
+        printf("Unknown mode %s\n", mode.c_str());
+        exit(-1);
+    }
+
+    /* the bounded searches are implemented by the round robin engine */
+    BfsQuery query;
+    if (!setup_query(argc, argv, &query))
+        exit(-1);
+    if (query.bounded() && (mode != "rr" || cmdOptionExists(argv, argv + argc, "--sources")))
+    {
+        printf("--exists, --top and --depth need --mode rr and a single start node\n");
+        exit(-1);
+    }
+
+    size_t split_degree = (cmdOptionExists(argv, argv + argc, "--split")) ? atol(getCmdOption(argv, argv + argc, "--split"))
+                                                                          : 0;
+
+    /* the incoming adjacencies are built before starting the timer */
+    CSRGraph *rg = NULL;
+    if (mode == "hybrid")
+        rg = (use_csr) ? transpose_graph(csr) : transpose_graph(g);
+
+    /* the graph is copied on the NUMA nodes before starting the timer, as a plain CSR */
+    if (mode == "numa" && cmdOptionExists(argv, argv + argc, "--compress"))
+    {
+        printf("--mode numa runs on the uncompressed graph only\n");
+        exit(-1);
+    }
+    NumaLayout *layout = NULL;
+    CSRGraph *placed = NULL;
+    bool per_core = !(cmdOptionExists(argv, argv + argc, "--pin") && string(getCmdOption(argv, argv + argc, "--pin")) == "sockets");
+    if (mode == "numa")
+    {
+        layout = new NumaLayout(NumaTopology::detect(), n_workers, (use_csr) ? csr->n_nodes : g->n_nodes);
+        placed = (use_csr) ? numa_place(csr, *layout) : numa_place(g, *layout);
+    }
+
+    if (cmdOptionExists(argv, argv + argc, "--simd") && !simd_set_level(getCmdOption(argv, argv + argc, "--simd")))
+    {
+        printf("Unknown simd level %s\n", getCmdOption(argv, argv + argc, "--simd"));
+        exit(-1);
+    }
+
+    /* the policy of the specialized engine */
+    BfsPolicyConfig policy;
+    if (cmdOptionExists(argv, argv + argc, "--visited"))
+        policy.visited = getCmdOption(argv, argv + argc, "--visited");
+    if (cmdOptionExists(argv, argv + argc, "--frontier"))
+        policy.frontier = getCmdOption(argv, argv + argc, "--frontier");
+    if (cmdOptionExists(argv, argv + argc, "--chunk"))
+        policy.chunk_size = atoi(getCmdOption(argv, argv + argc, "--chunk"));
+
+    bool spin = cmdOptionExists(argv, argv + argc, "--barrier") && string(getCmdOption(argv, argv + argc, "--barrier")) == "spin";
+    if (cmdOptionExists(argv, argv + argc, "--spin"))
+        SpinBarrier::default_budget = atol(getCmdOption(argv, argv + argc, "--spin"));
+
+    /* the frontier entries prefetched ahead by the rr mode */
+    if (cmdOptionExists(argv, argv + argc, "--prefetch"))
+        prefetch_distance = atol(getCmdOption(argv, argv + argc, "--prefetch"));
+
+    /* the least edges plus nodes of a level run in parallel by the rr and engine modes, calibrated by default */
+    long cutoff = (cmdOptionExists(argv, argv + argc, "--cutoff")) ? atol(getCmdOption(argv, argv + argc, "--cutoff"))
+                                                                   : -1;
+
+    /* the partition of the levels of the rr mode, by entries or by edges */
+    string balance = (cmdOptionExists(argv, argv + argc, "--balance")) ? getCmdOption(argv, argv + argc, "--balance")
+                                                                       : "nodes";
+    if (balance != "nodes" && balance != "edges")
+    {
+        printf("Unknown balance %s\n", balance.c_str());
+        exit(-1);
+    }
+    bool edge_balance = (balance == "edges");
+
+    /* the engine and index modes repeat the same search, reusing the engine or the index */
+    int repeat = (cmdOptionExists(argv, argv + argc, "--repeat")) ? atoi(getCmdOption(argv, argv + argc, "--repeat"))
+                                                                  : 1;
+
+    /* runs the selected engine on the graph representation of `graph` with the barrier B */
+    auto run = [&](auto *graph, auto *barrier_type)
+    {
+        using B = typename std::remove_pointer<decltype(barrier_type)>::type;
+        if (mode == "hybrid")
+            return hybrid_bfs<B>(graph, rg, start_node, search_value, n_workers);
+        else if (mode == "policy")
+        {
+            int occ = -1;
+            if (!dispatch_policy_bfs<B>(graph, start_node, search_value, n_workers, policy, &occ))
+            {
+                printf("No engine for --visited %s --frontier %s --chunk %d\n", policy.visited.c_str(),
+                       policy.frontier.c_str(), policy.chunk_size);
+                exit(-1);
+            }
+            return occ;
+        }
+        else if (mode == "numa")
+            return numa_bfs<B>(placed, *layout, start_node, search_value, per_core);
+        else if (mode == "nomerge" || mode == "bitmap")
+            return parallel_bfs_nomerge<B>(graph, start_node, search_value, n_workers, mode == "bitmap");
+        else if (mode == "steal")
+            return parallel_bfs_steal<B>(graph, start_node, search_value, n_workers, default_steal_chunk, split_degree);
+        else if (mode == "async")
+            return async_bfs(graph, start_node, search_value, n_workers);
+        else if (mode == "static")
+            return __parallel_bfs_static<B>(graph, start_node, search_value, n_workers);
+        return dispatch_parallel_bfs<B>(graph, start_node, search_value, n_workers, CHUNK_SIZE, query, cutoff, edge_balance);
+    };
+
+    /* the searches on `graph` with the barrier B, the engine or the index they reuse built here, before the timer */
+    auto prepare = [&](auto *graph, auto *barrier_type) -> function<int()>
+    {
+        using G = typename std::remove_pointer<decltype(graph)>::type;
+        using B = typename std::remove_pointer<decltype(barrier_type)>::type;
+        if (mode == "engine")
+        {
+            function<int(int, int)> engine = make_policy_engine<G, B>(graph, n_workers, CHUNK_SIZE, cutoff);
+            return [=]()
+            {
+                int occ = -1;
+                for (int i = 0; i < repeat; i++)
+                    occ = engine(start_node, search_value);
+                return occ;
+            };
+        }
+        else if (mode == "index")
+        {
+            shared_ptr<ValueIndex<G>> index;
+            {
+                utimer tindex("tindex");
+                index.reset(new ValueIndex<G>(graph, n_workers));
+            }
+            printf("Index by %s\n", (index->by_component()) ? "component" : "start node");
+            return [=]()
+            {
+                int occ = -1;
+                for (int i = 0; i < repeat; i++)
+                    occ = index->count(start_node, search_value);
+                return occ;
+            };
+        }
+        return [&, graph, barrier_type]()
+        { return run(graph, barrier_type); };
+    };
+
+    /* the compressed copy replaces the graph, built before starting the timer */
+    CompressedGraph *cg = setup_compressed(argc, argv, n_workers, &g, &csr);
+
+    /* the multi-source search, one count per start node */
+    if (cmdOptionExists(argv, argv + argc, "--sources"))
+    {
+        if (cg != NULL)
+        {
+            printf("--sources runs on the uncompressed graph only\n");
+            exit(-1);
+        }
+        vector<int> orig_start_nodes = parseIntList(getCmdOption(argv, argv + argc, "--sources"));
+        vector<int> start_nodes;
+        for (auto &s : orig_start_nodes)
+            start_nodes.push_back((use_csr) ? csr->node_id(s) : s);
+        vector<int> occs;
+        {
+            utimer tpar("tpar");
+            if (spin)
+                occs = (use_csr) ? parallel_multi_source_bfs<SpinBarrier>(csr, start_nodes, search_value, n_workers)
+                                 : parallel_multi_source_bfs<SpinBarrier>(g, start_nodes, search_value, n_workers);
+            else
+                occs = (use_csr) ? parallel_multi_source_bfs(csr, start_nodes, search_value, n_workers)
+                                 : parallel_multi_source_bfs(g, start_nodes, search_value, n_workers);
+        }
+        for (size_t i = 0; i < start_nodes.size(); i++)
+            std::cout << "Occurrences[" << orig_start_nodes[i] << "]: " << occs[i] << endl;
+
+        delete g;
+        delete csr;
+        delete rg;
+        delete placed;
+        delete layout;
+        return 0;
+    }
+
+    /* the cutoff of the rr mode is calibrated on the graph once, before starting the timer */
+    if (mode == "rr" && cutoff < 0 && n_workers > 1)
+    {
+        auto calibrate = [&](auto *graph)
+        {
+            return (spin) ? parallel_bfs_cutoff<SpinBarrier>(graph, n_workers) : parallel_bfs_cutoff<Barrier>(graph, n_workers);
+        };
+        cutoff = (cg != NULL) ? calibrate(cg) : (use_csr) ? calibrate(csr) : calibrate(g);
+    }
+
+    int occ = -1;
+    {
+        function<int()> search;
+        if (cg != NULL)
+            search = (spin) ? prepare(cg, (SpinBarrier *)NULL) : prepare(cg, (Barrier *)NULL);
+        else if (spin)
+            search = (use_csr) ? prepare(csr, (SpinBarrier *)NULL) : prepare(g, (SpinBarrier *)NULL);
+        else
+            search = (use_csr) ? prepare(csr, (Barrier *)NULL) : prepare(g, (Barrier *)NULL);
+
         utimer tpar("tpar");
-        occ = parallel_bfs(g, start_node, search_value, n_workers);
+        occ = search();
     }
     std::cout << "Occurrences: " << occ << endl;
 
 
     delete g;
+    delete csr;
+    delete cg;
+    delete rg;
+    delete placed;
+    delete layout;
     return 0;
 }
 #endif
@@ -0,0 +1,134 @@
+/**
+ * @file bitmap.cpp
+ * @author Marco Costa
+ * @brief Concurrent bitmap over the graph nodes, used for frontiers and visited sets
+ * @version 0.1
+ * @date 2021-09-08
+ */
+#ifndef BITMAP_CPP
+#define BITMAP_CPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @brief Bitmap of `n_bits` bits packed in 64-bit atomic words. Setting a bit is a
+ *        `fetch_or`, so concurrent setters of the same bit agree on who set it first.
+ *        Scanning the words in order visits the set bits in increasing order.
+ */
+class AtomicBitmap
+{
+public:
+    size_t n_bits;
+    size_t n_words;
+
+    /**
+     * @brief With `zero` false the words are left uninitialized, to be cleared with `clear(first, last)`
+     *        by the threads which should touch them first
+     */
+    explicit AtomicBitmap(size_t n_bits, bool zero = true) : n_bits(n_bits), n_words((n_bits + 63) / 64)
+    {
+        words = new std::atomic<uint64_t>[n_words];
+        if (zero)
+            clear();
+    }
+
+    ~AtomicBitmap()
+    {
+        delete[] words;
+    }
+
+    AtomicBitmap(const AtomicBitmap &) = delete;
+    AtomicBitmap &operator=(const AtomicBitmap &) = delete;
+
+    inline bool test(size_t i) const
+    {
+        return (words[i >> 6].load(std::memory_order_relaxed) >> (i & 63)) & 1;
+    }
+
+    /* brings the word of the bit i in cache, to be set */
+    inline void prefetch(size_t i) const
+    {
+        __builtin_prefetch(&words[i >> 6], 1);
+    }
+
+    /**
+     * @brief Sets the bit i
+     *
+     * @return true if the bit was not set before, i.e. the caller is the one who set it
+     */
+    inline bool set(size_t i)
+    {
+        uint64_t mask = (uint64_t)1 << (i & 63);
+        return !(words[i >> 6].fetch_or(mask, std::memory_order_relaxed) & mask);
+    }
+
+    /**
+     * @brief Sets the bit i if it is not set yet, the plain load in front avoids the
+     *        read-modify-write on the already visited nodes (the common case)
+     *
+     * @return true only for the one caller which set the bit
+     */
+    inline bool claim(size_t i)
+    {
+        return !test(i) && set(i);
+    }
+
+    /**
+     * @brief The words as plain 32-bit halves (in little endian order), for the vector kernels
+     *        gathering many of them at once. A gather cannot be an atomic load, so it is a
+     *        deliberate, benign data race with the `set` of the other threads: a bit being set
+     *        concurrently may be seen still clear, never the opposite, and every node seen
+     *        clear is claimed again with `set`. The kernels are excluded from ThreadSanitizer
+     *        (`SIMD_NO_TSAN`), the scalar ones read the halves with relaxed atomic loads.
+     */
+    inline const uint32_t *raw_words32() const
+    {
+        static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t), "the atomic words must be plain words");
+        return reinterpret_cast<const uint32_t *>(words);
+    }
+
+    inline uint64_t get_word(size_t w) const
+    {
+        return words[w].load(std::memory_order_relaxed);
+    }
+
+    inline void clear_word(size_t w)
+    {
+        words[w].store(0, std::memory_order_relaxed);
+    }
+
+    void clear()
+    {
+        clear(0, n_words);
+    }
+
+    /**
+     * @brief Clears the words [first, last)
+     */
+    void clear(size_t first, size_t last)
+    {
+        for (size_t w = first; w < last; w++)
+            clear_word(w);
+    }
+
+    /**
+     * @brief Calls f(i) for every bit i set in the word w, in increasing order
+     */
+    template <typename F>
+    inline void for_each_in_word(size_t w, F f) const
+    {
+        uint64_t bits = get_word(w);
+        while (bits)
+        {
+            f((w << 6) + __builtin_ctzll(bits));
+            bits &= bits - 1;
+        }
+    }
+
+private:
+    std::atomic<uint64_t> *words;
+};
+
+#endif
@@ -0,0 +1,322 @@
+/**
+ * @file compressed_graph.cpp
+ * @author Marco Costa
+ * @brief Graph with gap encoded adjacencies (StreamVByte layout), decoded on the fly by the searches
+ * @version 0.1
+ * @date 2021-09-08
+ */
+#ifndef COMPRESSED_GRAPH_CPP
+#define COMPRESSED_GRAPH_CPP
+
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <iterator>
+#include <cstdint>
+#include <cstring>
+
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+#include "graph.cpp"
+
+/*
+ * The adjacency of a node is stored as its degree (LEB128 varint), then the StreamVByte
+ * streams of the gaps between the sorted neighbors (the first one from 0): one control
+ * byte per group of 4 gaps, 2 bits each for the length 1-4 of the gap, then the bytes of
+ * the gaps. A group is decoded at once, with one shuffle when built with SSSE3.
+ */
+
+const static size_t compressed_padding = 16; /* a group is loaded as 16 bytes, also at the end */
+
+#ifdef __SSSE3__
+/* the shuffle moving the bytes of the 4 gaps of each control byte to their lanes, and their length */
+struct streamvbyte_lut
+{
+    uint8_t shuffle[256][16];
+    uint8_t length[256];
+
+    streamvbyte_lut()
+    {
+        for (int c = 0; c < 256; c++)
+        {
+            int pos = 0;
+            for (int q = 0; q < 4; q++)
+            {
+                int len = ((c >> (2 * q)) & 3) + 1;
+                for (int b = 0; b < 4; b++)
+                    shuffle[c][4 * q + b] = (b < len) ? pos + b : 0x80;
+                pos += len;
+            }
+            length[c] = pos;
+        }
+    }
+};
+
+static const streamvbyte_lut svb_lut;
+#endif
+
+/**
+ * @brief Input iterator over a compressed adjacency: the neighbors of the current group are
+ *        kept decoded in the iterator, which `operator*` refers to
+ */
+class compressed_adj_iterator
+{
+public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = uint;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const uint *;
+    using reference = const uint &;
+
+    compressed_adj_iterator(const uint8_t *ctrl, const uint8_t *data, size_t n) : ctrl(ctrl), data(data), i(0), n(n)
+    {
+        if (n > 0)
+            decode();
+    }
+    explicit compressed_adj_iterator(size_t n) : ctrl(NULL), data(NULL), i(n), n(n) {}
+
+    inline const uint &operator*() const { return buf[i & 3]; }
+
+    inline compressed_adj_iterator &operator++()
+    {
+        if ((++i & 3) == 0 && i < n)
+            decode();
+        return *this;
+    }
+
+    inline compressed_adj_iterator operator++(int)
+    {
+        compressed_adj_iterator old = *this;
+        ++*this;
+        return old;
+    }
+
+    inline bool operator==(const compressed_adj_iterator &o) const { return i == o.i; }
+    inline bool operator!=(const compressed_adj_iterator &o) const { return i != o.i; }
+
+private:
+    const uint8_t *ctrl;
+    const uint8_t *data;
+    size_t i, n;
+    uint prev = 0;
+    uint buf[4];
+
+    /* the 4 neighbors of the next group, past the end of the list they are never read */
+    inline void decode()
+    {
+        uint8_t c = *ctrl++;
+#ifdef __SSSE3__
+        __m128i gaps = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data),
+                                        _mm_loadu_si128((const __m128i *)svb_lut.shuffle[c]));
+        data += svb_lut.length[c];
+        gaps = _mm_add_epi32(gaps, _mm_slli_si128(gaps, 4));
+        gaps = _mm_add_epi32(gaps, _mm_slli_si128(gaps, 8));
+        _mm_storeu_si128((__m128i *)buf, _mm_add_epi32(gaps, _mm_set1_epi32(prev)));
+        prev = buf[3];
+#else
+        static const uint32_t masks[4] = {0xFF, 0xFFFF, 0xFFFFFF, 0xFFFFFFFF};
+        for (int q = 0; q < 4; q++)
+        {
+            int len = (c >> (2 * q)) & 3;
+            uint32_t gap;
+            memcpy(&gap, data, sizeof(gap));
+            data += len + 1;
+            prev += gap & masks[len];
+            buf[q] = prev;
+        }
+#endif
+    }
+};
+
+/**
+ * @brief The compressed adjacency of a node, usable in a range-for
+ */
+struct compressed_adj
+{
+    const uint8_t *ctrl;
+    const uint8_t *data;
+    size_t n;
+
+    inline compressed_adj_iterator begin() const { return compressed_adj_iterator(ctrl, data, n); }
+    inline compressed_adj_iterator end() const { return compressed_adj_iterator(n); }
+    inline size_t size() const { return n; }
+};
+
+/**
+ * @brief Read-only graph with the accessors of `CSRGraph`, whose adjacencies are gap
+ *        encoded in a single byte array: an edge takes 1 to 4 bytes plus 2 bits instead
+ *        of 4 bytes, so a search moves less memory for some decoding work.
+ *        The adjacencies are sorted by the encoding.
+ */
+class CompressedGraph
+{
+public:
+    uint n_nodes;
+    eid_t n_edges;
+    eid_t *offsets; /* n_nodes + 1 positions in `bytes` */
+    uint8_t *bytes;
+    short *values;
+    uint *orig_ids = NULL; /* as in `CSRGraph` */
+    uint *node_ids = NULL;
+
+    /**
+     * @brief Encodes the graph `g` with `n_workers` workers, each on a range of nodes
+     *
+     * @tparam G the graph representation (`Graph` or `CSRGraph`)
+     */
+    template <typename G>
+    explicit CompressedGraph(const G *g, int n_workers = 1) : n_nodes(g->n_nodes), n_edges(0)
+    {
+        n_workers = max(n_workers, 1);
+        offsets = new eid_t[(size_t)n_nodes + 1];
+        values = new short[n_nodes];
+
+        bool relabeled = false;
+        for (uint i = 0; i < n_nodes && !relabeled; i++)
+            relabeled = (g->orig_id(i) != i);
+        if (relabeled)
+        {
+            orig_ids = new uint[n_nodes];
+            node_ids = new uint[n_nodes];
+        }
+
+        /* runs f(i, sorted adjacency of i) on the nodes, one range per worker */
+        auto for_each_node = [&](auto f)
+        {
+            auto worker = [&](int w)
+            {
+                vector<uint> adj;
+                uint last = (uint)((uint64_t)n_nodes * (w + 1) / n_workers);
+                for (uint i = (uint)((uint64_t)n_nodes * w / n_workers); i < last; i++)
+                {
+                    adj.assign(g->get_adj(i).begin(), g->get_adj(i).end());
+                    sort(adj.begin(), adj.end());
+                    f(i, adj);
+                }
+            };
+            vector<thread> threads;
+            for (int w = 1; w < n_workers; w++)
+                threads.emplace_back(worker, w);
+            worker(0);
+            for (auto &t : threads)
+                t.join();
+        };
+
+        /* first pass, the encoded sizes */
+        for_each_node([&](uint i, const vector<uint> &adj)
+                      {
+            size_t size = varint_size(adj.size()) + (adj.size() + 3) / 4;
+            uint prev = 0;
+            for (auto &val : adj)
+            {
+                size += gap_size(val - prev);
+                prev = val;
+            }
+            offsets[i + 1] = size; });
+
+        offsets[0] = 0;
+        for (uint i = 0; i < n_nodes; i++)
+        {
+            offsets[i + 1] += offsets[i];
+            n_edges += g->get_degree(i);
+        }
+        bytes = new uint8_t[offsets[n_nodes] + compressed_padding]();
+
+        /* second pass, the encoding */
+        for_each_node([&](uint i, const vector<uint> &adj)
+                      {
+            values[i] = g->get_value(i);
+            if (orig_ids != NULL)
+            {
+                orig_ids[i] = g->orig_id(i);
+                node_ids[orig_ids[i]] = i;
+            }
+
+            uint8_t *p = bytes + offsets[i];
+            for (size_t d = adj.size(); ; d >>= 7)
+            {
+                *p++ = (d & 127) | ((d >= 128) ? 128 : 0);
+                if (d < 128)
+                    break;
+            }
+
+            uint8_t *ctrl = p;
+            uint8_t *data = p + (adj.size() + 3) / 4;
+            uint prev = 0;
+            for (size_t k = 0; k < adj.size(); k++)
+            {
+                uint gap = adj[k] - prev;
+                int len = gap_size(gap);
+                ctrl[k / 4] |= (len - 1) << (2 * (k % 4));
+                memcpy(data, &gap, len); /* little endian */
+                data += len;
+                prev = adj[k];
+            } });
+    }
+
+    ~CompressedGraph()
+    {
+        delete[] offsets;
+        delete[] bytes;
+        delete[] values;
+        delete[] orig_ids;
+        delete[] node_ids;
+    }
+
+    CompressedGraph(const CompressedGraph &) = delete;
+    CompressedGraph &operator=(const CompressedGraph &) = delete;
+
+    inline short get_value(uint node_i) const { return values[node_i]; }
+
+    inline compressed_adj get_adj(uint node_i) const
+    {
+        size_t d;
+        const uint8_t *p = degree(node_i, &d);
+        return {p, p + (d + 3) / 4, d};
+    }
+
+    inline size_t get_degree(uint node_i) const
+    {
+        size_t d;
+        degree(node_i, &d);
+        return d;
+    }
+
+    inline uint orig_id(uint node_i) const { return (orig_ids != NULL) ? orig_ids[node_i] : node_i; }
+    inline uint node_id(uint orig_i) const { return (node_ids != NULL) ? node_ids[orig_i] : orig_i; }
+
+    /* the bytes of the adjacencies, what the neighbors of a CSR take is 4 * n_edges */
+    inline size_t adj_bytes() const { return offsets[n_nodes]; }
+
+private:
+    static inline size_t varint_size(size_t v)
+    {
+        size_t size = 1;
+        while (v >= 128)
+        {
+            v >>= 7;
+            size++;
+        }
+        return size;
+    }
+
+    static inline int gap_size(uint gap)
+    {
+        return (gap < (1u << 8)) ? 1 : (gap < (1u << 16)) ? 2 : (gap < (1u << 24)) ? 3 : 4;
+    }
+
+    /* reads the degree of the node, returns where its control bytes start */
+    inline const uint8_t *degree(uint node_i, size_t *d) const
+    {
+        const uint8_t *p = bytes + offsets[node_i];
+        size_t v = *p & 127;
+        for (int shift = 7; *p++ & 128; shift += 7)
+            v |= (size_t)(*p & 127) << shift;
+        *d = v;
+        return p;
+    }
+};
+
+#endif
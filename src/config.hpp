@@ -9,7 +9,9 @@
 #ifndef CONFIG_HPP
 #define CONFIG_HPP
 
-#define CHUNK_SIZE 2 /* the size of the chunk (number of sequential integers) */
+#include <cstddef>
+
+const static int CHUNK_SIZE = 2; /* the size of the chunk (number of sequential integers) */
 
 const static int default_start_node = 0;
 const static int default_search_value = 5;
@@ -17,4 +19,22 @@ const static int default_max_value = 6;
 const static int default_seed_value = 1234;
 const static int default_percent_value = 35;
 
+const static size_t default_spin_budget = 1 << 16; /* pauses a `SpinBarrier` waiter spins before sleeping */
+const static size_t default_steal_chunk = 64; /* frontier entries below which a stolen range is not split */
+const static size_t default_arena_block = 256; /* frontier entries per block of a `FrontierArena`, 1 KiB */
+const static size_t default_cutoff_sample = 256; /* nodes expanded to measure the cost of an edge */
+const static int default_cutoff_rounds = 32;     /* empty parallel levels to measure their cost */
+const static size_t default_prefetch_distance = 0; /* frontier entries prefetched ahead, 0 for no prefetch */
+const static size_t default_deque_log_size = 10; /* initial capacity of a `ChaseLevDeque`, 2^10 nodes */
+const static int default_server_window = 0; /* usec a server batch waits for more queries after the first */
+const static size_t default_server_max_line = 1 << 12; /* longest query line a server client may send */
+const static double default_bench_tolerance = 20; /* percent a median may grow over its baseline */
+const static double default_bench_floor_us = 100; /* medians below it are not compared with a baseline */
+const static int default_index_updates = 64; /* random updates through a `ValueIndex` checked by `--verify` */
+const static int default_index_batch = 8;    /* updates between two checks of the `ValueIndex` */
+
+/* direction-optimizing BFS thresholds (Beamer et al.) */
+const static int default_hybrid_alpha = 14; /* go bottom-up when frontier edges > unexplored edges / alpha */
+const static int default_hybrid_beta = 24;  /* go back top-down when frontier nodes < n_nodes / beta */
+
 #endif
\ No newline at end of file
@@ -0,0 +1,190 @@
+/**
+ * @file cutoff.cpp
+ * @author Marco Costa
+ * @brief The adaptive cutoff between the levels expanded by the master and by the workers
+ * @version 0.1
+ * @date 2021-09-08
+ */
+#ifndef CUTOFF_CPP
+#define CUTOFF_CPP
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <map>
+#include <string>
+#include <chrono>
+#include <cstdint>
+#include <typeinfo>
+#include <climits>
+
+#include "config.hpp"
+
+/**
+ * @brief Decides whether a level is expanded inline by the master. A parallel level pays a
+ *        fixed cost, waking the workers and waiting for all of them, which is worth it only
+ *        when the frontier has enough work: with the work of a level measured as its edges
+ *        plus its nodes, in parallel it saves work * edge_ns * (1 - 1 / n_workers), so the
+ *        break even is at round_trip_ns / (edge_ns * (1 - 1 / n_workers)).
+ *        The two costs are measured when the engine starts: the round trip of its workers
+ *        (once per process for the engines started by each search, it does not depend on
+ *        the graph) and the sequential expansion of a sample of the graph, by each engine
+ *        object. The engines started by each search take the cutoff as an argument instead,
+ *        calibrated once before the searches (`parallel_bfs_cutoff`, `ff_bfs_cutoff`).
+ */
+class LevelCutoff
+{
+public:
+    size_t min_work; /* the least work of a level expanded in parallel, 0 to always go parallel */
+
+    explicit LevelCutoff(size_t min_work = 0) : min_work(min_work) {}
+
+    /**
+     * @brief The cutoff calibrated on the graph `g`, nothing is measured with a single worker
+     *
+     * @tparam G the graph representation (`Graph`, `CSRGraph` or `CompressedGraph`)
+     * @tparam R double(), the cost of an empty parallel level of the engine
+     * @tparam P bool(uint), the visited test of the engine, applied to every sampled neighbor
+     */
+    template <typename G, typename R, typename P>
+    LevelCutoff(const G *g, int n_workers, R round_trip_ns, P probe)
+        : min_work((n_workers > 1) ? break_even(round_trip_ns(), edge_ns(g, probe), n_workers) : SIZE_MAX)
+    {
+    }
+
+    /**
+     * @brief Whether the frontier of `n` entries, the i-th of degree `degree(i)`, is expanded
+     *        inline; the degrees are summed only up to the cutoff
+     */
+    template <typename F>
+    inline bool sequential(size_t n, F degree) const
+    {
+        if (min_work == 0 || n >= min_work)
+            return false;
+        size_t work = n;
+        for (size_t i = 0; i < n; i++)
+        {
+            work += degree(i);
+            if (work >= min_work)
+                return false;
+        }
+        return true;
+    }
+
+    /* the cutoff as the `cutoff` argument of the engines, 0 to always go parallel */
+    inline long as_argument() const
+    {
+        return (min_work > (size_t)LONG_MAX) ? LONG_MAX : (long)min_work;
+    }
+
+    /* the smallest work worth a parallel level, none with a single worker */
+    static size_t break_even(double round_trip_ns, double edge_ns, int n_workers)
+    {
+        if (n_workers <= 1)
+            return SIZE_MAX;
+        double saved_ns = edge_ns * (1.0 - 1.0 / n_workers);
+        return (saved_ns > 0) ? (size_t)(round_trip_ns / saved_ns) + 1 : 1;
+    }
+
+    /**
+     * @brief The cost (in nanoseconds) of a node or an edge expanded sequentially, measured
+     *        on the adjacencies of `default_cutoff_sample` nodes spread over the graph:
+     *        one pass to warm up, one timed
+     */
+    template <typename G, typename P>
+    static double edge_ns(const G *g, P probe)
+    {
+        if (g->n_nodes == 0)
+            return 1;
+
+        size_t sink = 0, work = 0;
+        auto sample = [&]()
+        {
+            for (size_t k = 0; k < default_cutoff_sample; k++)
+            {
+                uint i = (uint)((uint64_t)g->n_nodes * k / default_cutoff_sample);
+                sink += g->get_value(i);
+                for (auto &val : g->get_adj(i))
+                    sink += probe(val);
+                work += g->get_degree(i) + 1;
+            }
+        };
+
+        sample();
+        work = 0;
+        auto start = std::chrono::steady_clock::now();
+        sample();
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        volatile size_t keep = sink; /* the sample is not optimized out */
+        (void)keep;
+        return (ns > 0) ? ns / work : 1;
+    }
+
+    /**
+     * @brief The average cost (in nanoseconds) of `level()`, an empty parallel level, after a
+     *        first one to warm up
+     */
+    template <typename F>
+    static double round_trip_ns(F level)
+    {
+        level();
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < default_cutoff_rounds; r++)
+            level();
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        return ns / default_cutoff_rounds;
+    }
+
+    /**
+     * @brief The value of `measure()` for the key and the number of workers, measured by the
+     *        first call only: the cost of a level of the engines started for each search
+     */
+    template <typename F>
+    static double cached_ns(const std::string &key, int n_workers, F measure)
+    {
+        static std::mutex cache_mutex;
+        static std::map<std::pair<std::string, int>, double> cache;
+        std::lock_guard<std::mutex> lock{cache_mutex};
+
+        auto it = cache.find({key, n_workers});
+        if (it == cache.end())
+            it = cache.emplace(std::make_pair(key, n_workers), measure()).first;
+        return it->second;
+    }
+
+    /**
+     * @brief The round trip of the barrier B with `n_workers` workers, as in `parallel_bfs`:
+     *        the master releases the parked workers and waits for all of them
+     */
+    template <typename B>
+    static double barrier_round_trip_ns(int n_workers)
+    {
+        return cached_ns(typeid(B).name(), n_workers, [&]()
+                         {
+            B barrier(n_workers);
+            bool over = false;
+            std::vector<std::thread> threads;
+            for (int i = 0; i < n_workers; i++)
+                threads.emplace_back([&]()
+                                     {
+                    while (true)
+                    {
+                        barrier.WorkerWait();
+                        if (over)
+                            return;
+                    } });
+
+            barrier.MasterWait();
+            double ns = round_trip_ns([&]()
+                                      {
+                barrier.StartWorkers();
+                barrier.MasterWait(); });
+            over = true;
+            barrier.StartWorkers();
+            for (auto &t : threads)
+                t.join();
+            return ns; });
+    }
+};
+
+#endif
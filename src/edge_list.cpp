@@ -0,0 +1,271 @@
+/**
+ * @file edge_list.cpp
+ * @author Marco Costa
+ * @brief Streaming loader of text and binary edge lists into a CSR, parsed in parallel
+ * @version 0.1
+ * @date 2021-09-08
+ */
+#ifndef EDGE_LIST_CPP
+#define EDGE_LIST_CPP
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "graph.cpp"
+
+/*
+ * The edge list formats: a text file with one `u v` edge per line (further columns are
+ * ignored, empty lines and lines starting with '#' or '%' are comments), or, for the
+ * files named *.bin, the binary sequence of the (uint32 u, uint32 v) pairs in host order.
+ */
+
+/* runs f(w) on the workers 0 .. n_workers - 1 */
+template <typename F>
+void run_workers(int n_workers, F f)
+{
+    vector<thread> threads;
+    for (int w = 1; w < n_workers; w++)
+        threads.emplace_back(f, w);
+    f(0);
+    for (auto &t : threads)
+        t.join();
+}
+
+/**
+ * @brief Calls f(u, v) on the edges of the lines which start in [first, last) of the text
+ *        `data`. A line is parsed by the worker whose range holds its first byte.
+ *
+ * @return bool false if a line is not an edge
+ */
+template <typename F>
+bool parse_text_edges(const char *data, size_t size, size_t first, size_t last, F f)
+{
+    size_t i = first;
+    if (i > 0 && data[i - 1] != '\n')
+    {
+        while (i < size && data[i] != '\n')
+            i++;
+        i++;
+    }
+
+    auto blank = [&](size_t j)
+    { return j < size && (data[j] == ' ' || data[j] == '\t'); };
+    auto number = [&](size_t &j, uint64_t &val)
+    {
+        size_t begin = j;
+        val = 0;
+        while (j < size && data[j] >= '0' && data[j] <= '9' && val < UINT32_MAX)
+            val = val * 10 + (data[j++] - '0');
+        return j > begin && val < UINT32_MAX;
+    };
+
+    while (i < last && i < size)
+    {
+        while (blank(i))
+            i++;
+        if (i < size && data[i] != '\n' && data[i] != '\r' && data[i] != '#' && data[i] != '%')
+        {
+            uint64_t u, v;
+            if (!number(i, u) || !blank(i))
+                return false;
+            while (blank(i))
+                i++;
+            if (!number(i, v))
+                return false;
+            f((uint)u, (uint)v);
+        }
+
+        while (i < size && data[i] != '\n')
+            i++;
+        i++;
+    }
+    return true;
+}
+
+/**
+ * @brief Loads an edge list file into a CSRGraph. The file is mapped and read by
+ *        `n_workers` workers, each on its own range of bytes, twice: the first pass
+ *        counts the out-degrees, the second one writes every neighbor at its place
+ *        (after one more pass finding the number of nodes, if not given). The lists are
+ *        then sorted and the duplicate edges dropped in place, so the memory is the CSR
+ *        itself (with room for the duplicates) and the mapped file, never a per node
+ *        container. The values are drawn as in `CSRGraph::generate_graph_parallel`.
+ *
+ * @param filename the edge list, binary if it ends with ".bin", text otherwise
+ * @param n_nodes the number of nodes, the highest id in the file plus one if 0
+ * @param seed the seed of the values
+ * @param max_value the values are in [1, max_value]
+ * @param n_workers the number of workers
+ * @return CSRGraph* the graph, NULL if the file cannot be read or holds an invalid edge
+ */
+CSRGraph *load_edge_list(string filename, uint n_nodes, int seed, short max_value, int n_workers)
+{
+    n_workers = max(n_workers, 1);
+    bool binary = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".bin") == 0;
+
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        perror(filename.c_str());
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        perror(filename.c_str());
+        close(fd);
+        return NULL;
+    }
+    size_t size = st.st_size;
+    if (binary && size % (2 * sizeof(uint32_t)) != 0)
+    {
+        fprintf(stderr, "%s: not a binary edge list\n", filename.c_str());
+        close(fd);
+        return NULL;
+    }
+
+    const char *data = NULL;
+    if (size > 0)
+    {
+        void *addr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED)
+        {
+            perror(filename.c_str());
+            close(fd);
+            return NULL;
+        }
+        madvise(addr, size, MADV_SEQUENTIAL);
+        data = (const char *)addr;
+    }
+    close(fd); /* the mapping stays valid */
+
+    /* one parallel pass over the edges, f(w, u, v) */
+    atomic<bool> parsed{true};
+    auto for_each_edge = [&](auto f)
+    {
+        run_workers(n_workers, [&](int w)
+                    {
+            if (binary)
+            {
+                const uint32_t *pairs = (const uint32_t *)data;
+                size_t n_pairs = size / (2 * sizeof(uint32_t));
+                size_t last = n_pairs * (w + 1) / n_workers;
+                for (size_t e = n_pairs * w / n_workers; e < last; e++)
+                    f(w, pairs[2 * e], pairs[2 * e + 1]);
+            }
+            else if (!parse_text_edges(data, size, size * w / n_workers, size * (w + 1) / n_workers,
+                                       [&](uint u, uint v) { f(w, u, v); }))
+                parsed = false; });
+    };
+
+    atomic<bool> in_range{true};
+    if (n_nodes == 0)
+    {
+        vector<uint> max_id(n_workers);
+        vector<char> any(n_workers);
+        for_each_edge([&](int w, uint u, uint v)
+                      {
+            max_id[w] = max(max_id[w], max(u, v));
+            any[w] = true; });
+        for (int w = 0; w < n_workers; w++)
+            if (any[w])
+                n_nodes = max(n_nodes, max_id[w] + 1);
+    }
+
+    CSRGraph *g = new CSRGraph();
+    g->n_nodes = n_nodes;
+    g->offsets = new eid_t[(size_t)n_nodes + 1]();
+    g->values = new short[n_nodes];
+
+    /* first pass, offsets[u + 1] is the degree of u */
+    if (parsed)
+        for_each_edge([&](int, uint u, uint v)
+                      {
+            if (u >= n_nodes || v >= n_nodes)
+                in_range = false;
+            else
+                __atomic_fetch_add(&g->offsets[u + 1], 1, __ATOMIC_RELAXED); });
+
+    if (!parsed || !in_range)
+    {
+        fprintf(stderr, "%s: %s\n", filename.c_str(), (!parsed) ? "invalid edge list" : "node id out of range");
+        if (data != NULL)
+            munmap((void *)data, size);
+        delete g;
+        return NULL;
+    }
+
+    for (uint i = 0; i < n_nodes; i++)
+        g->offsets[i + 1] += g->offsets[i];
+    eid_t n_listed = g->offsets[n_nodes];
+    g->neighbors = new uint[n_listed];
+
+    /* second pass, offsets[u] is the next free place of u, then the start of u + 1 */
+    for_each_edge([&](int, uint u, uint v)
+                  { g->neighbors[__atomic_fetch_add(&g->offsets[u], 1, __ATOMIC_RELAXED)] = v; });
+    for (uint i = n_nodes; i > 0; i--)
+        g->offsets[i] = g->offsets[i - 1];
+    g->offsets[0] = 0;
+
+    if (data != NULL)
+        munmap((void *)data, size);
+
+    /* the nodes split in ranges of about the same number of edges, read before any change */
+    vector<uint> range_first(n_workers + 1);
+    vector<eid_t> range_start(n_workers + 1);
+    for (int w = 1; w <= n_workers; w++)
+    {
+        size_t k = upper_bound(g->offsets, g->offsets + n_nodes + 1, n_listed * w / n_workers) - g->offsets;
+        range_first[w] = (w == n_workers) ? n_nodes : max(range_first[w - 1], (uint)min<size_t>(k - 1, n_nodes));
+    }
+    for (int w = 0; w <= n_workers; w++)
+        range_start[w] = g->offsets[range_first[w]];
+
+    /* the lists sorted and deduplicated, compacted at the start of the range of the worker */
+    vector<eid_t> range_end(n_workers);
+    run_workers(n_workers, [&](int w)
+                {
+        eid_t pos = range_start[w];
+        for (uint i = range_first[w]; i < range_first[w + 1]; i++)
+        {
+            eid_t first = g->offsets[i];
+            eid_t last = (i + 1 < range_first[w + 1]) ? g->offsets[i + 1] : range_start[w + 1];
+            sort(g->neighbors + first, g->neighbors + last);
+            uint *end = unique(g->neighbors + first, g->neighbors + last);
+            g->offsets[i] = pos;
+            pos = copy(g->neighbors + first, end, g->neighbors + pos) - g->neighbors;
+        }
+        range_end[w] = pos;
+
+        for (uint i = range_first[w]; i < range_first[w + 1]; i++)
+            g->values[i] = (counter_rand(seed, i, 0) % max_value) + 1; });
+
+    /* the compacted ranges moved next to each other, in order so no range is overwritten */
+    eid_t n_edges = 0;
+    vector<eid_t> shift(n_workers);
+    for (int w = 0; w < n_workers; w++)
+    {
+        shift[w] = range_start[w] - n_edges;
+        memmove(g->neighbors + n_edges, g->neighbors + range_start[w], (range_end[w] - range_start[w]) * sizeof(uint));
+        n_edges += range_end[w] - range_start[w];
+    }
+    run_workers(n_workers, [&](int w)
+                {
+        for (uint i = range_first[w]; i < range_first[w + 1]; i++)
+            g->offsets[i] -= shift[w]; });
+    g->offsets[n_nodes] = n_edges;
+    g->n_edges = n_edges;
+
+    return g;
+}
+
+#endif
@@ -13,10 +13,24 @@
 #include <vector>
 #include <set>
 #include <random>
+#include <cstdint>
+#include <cmath>
+#include <thread>
+#include <atomic>
+#include <cstring>
+#include <cstdio>
+#include <cstddef>
+#include <algorithm>
+#include <iterator>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 using namespace std;
 
 typedef unsigned int uint;
+typedef uint64_t eid_t; /* edge index type, the CSR may hold more than 2^32 edges */
 static uint g_seed = 1234;
 
 inline int fastrand()
@@ -53,17 +67,26 @@ public:
     void set_value(uint node_i, short value);
     void print_dot();
 
+    /* uniform accessors used by the BFS engines, shared with `CSRGraph` */
+    inline short get_value(uint node_i) const { return nodes[node_i]->value; }
+    inline const vector<uint> &get_adj(uint node_i) const { return nodes[node_i]->adj; }
+    inline size_t get_degree(uint node_i) const { return nodes[node_i]->adj.size(); }
+
+    /* the node based graph is never relabeled */
+    inline uint orig_id(uint node_i) const { return node_i; }
+    inline uint node_id(uint orig_i) const { return orig_i; }
+
     static Graph *generate_graph(uint n_nodes, int seed, short max_value, int percent);
     static Graph *generate_graph_fast(uint n_nodes, uint n_edges, int seed, short max_value);
 
-    static void save_to_file(Graph *g, string filename);
+    static bool save_to_file(Graph *g, string filename);
     static Graph *load_from_file(string filename);
 };
 
 Graph::Graph(uint n_nodes)
 {
     this->n_nodes = n_nodes;
-    nodes.reserve(n_nodes);
+    nodes.resize(n_nodes);
 
     for (uint i = 0; i < n_nodes; i++)
         nodes[i] = new node();
@@ -172,4 +195,577 @@ void Graph::print_dot()
     printf("}\n");
 }
 
+/**
+ * @brief Contiguous range over the neighbors of a CSR node, usable in a range-for
+ */
+struct adj_range
+{
+    const uint *first;
+    const uint *last;
+
+    inline const uint *begin() const { return first; }
+    inline const uint *end() const { return last; }
+    inline size_t size() const { return last - first; }
+};
+
+/**
+ * @brief Compressed sparse row representation of a `Graph`: the adjacencies of
+ *        node i are neighbors[offsets[i], offsets[i + 1]) and its value is values[i].
+ *        The three arrays are contiguous, so a BFS step costs no pointer chasing.
+ */
+class CSRGraph
+{
+private:
+    void *mapping = NULL;   /* the file mapping backing the arrays, if any */
+    size_t mapping_size = 0;
+
+public:
+    uint n_nodes;
+    eid_t n_edges;
+    eid_t *offsets;  /* n_nodes + 1 entries */
+    uint *neighbors; /* n_edges entries */
+    short *values;   /* n_nodes entries */
+    uint *orig_ids = NULL; /* the original id of each node of a relabeled graph, NULL if not relabeled */
+    uint *node_ids = NULL; /* the inverse of `orig_ids` */
+
+    CSRGraph(uint n_nodes, eid_t n_edges);
+    explicit CSRGraph(const Graph *g);
+    CSRGraph() : n_nodes(0), n_edges(0), offsets(NULL), neighbors(NULL), values(NULL) {}
+    ~CSRGraph();
+
+    CSRGraph(const CSRGraph &) = delete;
+    CSRGraph &operator=(const CSRGraph &) = delete;
+
+    inline short get_value(uint node_i) const { return values[node_i]; }
+    inline adj_range get_adj(uint node_i) const { return {neighbors + offsets[node_i], neighbors + offsets[node_i + 1]}; }
+    inline size_t get_degree(uint node_i) const { return offsets[node_i + 1] - offsets[node_i]; }
+    inline uint orig_id(uint node_i) const { return (orig_ids != NULL) ? orig_ids[node_i] : node_i; }
+    inline uint node_id(uint orig_i) const { return (node_ids != NULL) ? node_ids[orig_i] : orig_i; }
+    void print_dot();
+    bool is_valid() const;
+
+    static bool save_to_file(const CSRGraph *g, string filename);
+    static CSRGraph *map_file(string filename);
+
+    static CSRGraph *generate_graph_parallel(uint n_nodes, int seed, short max_value, int percent, int n_workers);
+};
+
+/**
+ * @brief Header of the binary graph file. The file is the CSR itself: each section
+ *        starts at the given byte position (aligned to `graph_file_align`) and is
+ *        stored in the host byte order, so it can be mapped and used as is.
+ */
+struct graph_file_header
+{
+    char magic[8];          /* "SPMGRAPH" */
+    uint32_t version;       /* `graph_file_version` */
+    uint32_t flags;         /* `graph_flag_` bits */
+    uint64_t n_nodes;
+    uint64_t n_edges;
+    uint64_t offsets_pos;   /* (n_nodes + 1) eid_t */
+    uint64_t neighbors_pos; /* n_edges uint */
+    uint64_t values_pos;    /* n_nodes short */
+    /* since version 2, with `graph_flag_relabeled` only */
+    uint64_t orig_ids_pos;  /* n_nodes uint */
+    uint64_t node_ids_pos;  /* n_nodes uint */
+};
+
+const static char graph_file_magic[8] = {'S', 'P', 'M', 'G', 'R', 'A', 'P', 'H'};
+const static uint32_t graph_file_version = 2;
+const static uint32_t graph_flag_relabeled = 1; /* the file stores the permutation of a reordered graph */
+const static size_t graph_file_header_v1_size = offsetof(graph_file_header, orig_ids_pos);
+const static uint64_t graph_file_align = 64;
+
+inline uint64_t align_up(uint64_t pos, uint64_t align)
+{
+    return (pos + align - 1) / align * align;
+}
+
+/* whether `n` elements of `elem_size` bytes at byte position `pos` are within `size` bytes, without overflowing */
+inline bool section_fits(uint64_t pos, uint64_t n, uint64_t elem_size, uint64_t size)
+{
+    return pos <= size && n <= (size - pos) / elem_size;
+}
+
+/**
+ * @brief Allocates an empty CSR, the caller fills the arrays
+ */
+CSRGraph::CSRGraph(uint n_nodes, eid_t n_edges) : n_nodes(n_nodes), n_edges(n_edges)
+{
+    offsets = new eid_t[(size_t)n_nodes + 1];
+    neighbors = new uint[n_edges];
+    values = new short[n_nodes];
+}
+
+/**
+ * @brief Builds the CSR copying the adjacencies of the node-based graph `g`
+ */
+CSRGraph::CSRGraph(const Graph *g) : n_nodes(g->n_nodes), n_edges(0)
+{
+    for (uint i = 0; i < n_nodes; i++)
+        n_edges += g->get_degree(i);
+
+    offsets = new eid_t[(size_t)n_nodes + 1];
+    neighbors = new uint[n_edges];
+    values = new short[n_nodes];
+
+    eid_t pos = 0;
+    for (uint i = 0; i < n_nodes; i++)
+    {
+        offsets[i] = pos;
+        values[i] = g->get_value(i);
+        for (auto &val : g->get_adj(i))
+            neighbors[pos++] = val;
+    }
+    offsets[n_nodes] = pos;
+}
+
+CSRGraph::~CSRGraph()
+{
+    if (mapping != NULL)
+    {
+        munmap(mapping, mapping_size);
+        return;
+    }
+
+    delete[] offsets;
+    delete[] neighbors;
+    delete[] values;
+    delete[] orig_ids;
+    delete[] node_ids;
+}
+
+/**
+ * @brief Writes `g` to `filename` in the binary CSR format described by `graph_file_header`
+ *
+ * @return true on success
+ */
+bool CSRGraph::save_to_file(const CSRGraph *g, string filename)
+{
+    graph_file_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, graph_file_magic, sizeof(h.magic));
+    h.version = graph_file_version;
+    h.n_nodes = g->n_nodes;
+    h.n_edges = g->n_edges;
+    h.offsets_pos = align_up(sizeof(h), graph_file_align);
+    h.neighbors_pos = align_up(h.offsets_pos + (h.n_nodes + 1) * sizeof(eid_t), graph_file_align);
+    h.values_pos = align_up(h.neighbors_pos + h.n_edges * sizeof(uint), graph_file_align);
+    if (g->orig_ids != NULL)
+    {
+        h.flags |= graph_flag_relabeled;
+        h.orig_ids_pos = align_up(h.values_pos + h.n_nodes * sizeof(short), graph_file_align);
+        h.node_ids_pos = align_up(h.orig_ids_pos + h.n_nodes * sizeof(uint), graph_file_align);
+    }
+
+    FILE *f = fopen(filename.c_str(), "wb");
+    if (f == NULL)
+    {
+        perror(filename.c_str());
+        return false;
+    }
+
+    /* writes `size` bytes of `data` at byte position `pos`, zero padding the gap */
+    auto write_at = [&](uint64_t pos, const void *data, size_t size)
+    {
+        static const char zeros[graph_file_align] = {0};
+        uint64_t curr = ftell(f);
+        if (curr < pos && fwrite(zeros, 1, pos - curr, f) != pos - curr)
+            return false;
+        return fwrite(data, 1, size, f) == size;
+    };
+
+    bool ok = write_at(0, &h, sizeof(h)) &&
+              write_at(h.offsets_pos, g->offsets, (h.n_nodes + 1) * sizeof(eid_t)) &&
+              write_at(h.neighbors_pos, g->neighbors, h.n_edges * sizeof(uint)) &&
+              write_at(h.values_pos, g->values, h.n_nodes * sizeof(short));
+    if (ok && g->orig_ids != NULL)
+        ok = write_at(h.orig_ids_pos, g->orig_ids, h.n_nodes * sizeof(uint)) &&
+             write_at(h.node_ids_pos, g->node_ids, h.n_nodes * sizeof(uint));
+
+    if (fclose(f) != 0)
+        ok = false;
+    if (!ok)
+        fprintf(stderr, "%s: write error\n", filename.c_str());
+    return ok;
+}
+
+/**
+ * @brief Maps a file written by `save_to_file` read-only in memory, the returned
+ *        graph points straight into the mapping (no copies, no parsing). The file is not
+ *        trusted: its sections are bounds checked and its contents validated by `is_valid`,
+ *        a sequential pass over the mapping.
+ *
+ * @return CSRGraph* the graph, NULL if the file cannot be opened or is not valid
+ */
+CSRGraph *CSRGraph::map_file(string filename)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        perror(filename.c_str());
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < graph_file_header_v1_size)
+    {
+        fprintf(stderr, "%s: not a graph file\n", filename.c_str());
+        close(fd);
+        return NULL;
+    }
+
+    size_t size = st.st_size;
+    void *addr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); /* the mapping stays valid */
+    if (addr == MAP_FAILED)
+    {
+        perror(filename.c_str());
+        return NULL;
+    }
+
+    /* a version 1 header ends before the permutation fields, which are then never read */
+    const graph_file_header *h = (const graph_file_header *)addr;
+    bool relabeled = false;
+    bool valid = memcmp(h->magic, graph_file_magic, sizeof(h->magic)) == 0 &&
+                 (h->version == 1 || h->version == graph_file_version) &&
+                 h->n_nodes < UINT32_MAX &&
+                 section_fits(h->offsets_pos, h->n_nodes + 1, sizeof(eid_t), size) &&
+                 section_fits(h->neighbors_pos, h->n_edges, sizeof(uint), size) &&
+                 section_fits(h->values_pos, h->n_nodes, sizeof(short), size) &&
+                 h->offsets_pos % alignof(eid_t) == 0 &&
+                 h->neighbors_pos % alignof(uint) == 0 &&
+                 h->values_pos % alignof(short) == 0;
+    if (valid && h->version >= 2 && (h->flags & graph_flag_relabeled))
+    {
+        relabeled = true;
+        valid = size >= sizeof(graph_file_header) &&
+                section_fits(h->orig_ids_pos, h->n_nodes, sizeof(uint), size) &&
+                section_fits(h->node_ids_pos, h->n_nodes, sizeof(uint), size) &&
+                h->orig_ids_pos % alignof(uint) == 0 &&
+                h->node_ids_pos % alignof(uint) == 0;
+    }
+    if (!valid)
+    {
+        fprintf(stderr, "%s: not a graph file or unsupported version\n", filename.c_str());
+        munmap(addr, size);
+        return NULL;
+    }
+
+    /* the sequential scan of the BFS engines is on the offsets, neighbors are random */
+    madvise(addr, size, MADV_WILLNEED);
+
+    CSRGraph *g = new CSRGraph();
+    g->n_nodes = h->n_nodes;
+    g->n_edges = h->n_edges;
+    g->offsets = (eid_t *)((char *)addr + h->offsets_pos);
+    g->neighbors = (uint *)((char *)addr + h->neighbors_pos);
+    g->values = (short *)((char *)addr + h->values_pos);
+    if (relabeled)
+    {
+        g->orig_ids = (uint *)((char *)addr + h->orig_ids_pos);
+        g->node_ids = (uint *)((char *)addr + h->node_ids_pos);
+    }
+    g->mapping = addr;
+    g->mapping_size = size;
+
+    /* the contents are checked too, the engines index the arrays with them unchecked */
+    if (!g->is_valid())
+    {
+        fprintf(stderr, "%s: corrupted graph file\n", filename.c_str());
+        delete g;
+        return NULL;
+    }
+
+    return g;
+}
+
+/**
+ * @brief Whether the arrays are a well formed CSR: the offsets start from 0, never decrease
+ *        and end at `n_edges`, every neighbor is a node, and the permutation of a relabeled
+ *        graph is a permutation with its inverse. One pass over the arrays.
+ */
+bool CSRGraph::is_valid() const
+{
+    if (offsets[0] != 0 || offsets[n_nodes] != n_edges)
+        return false;
+    for (uint i = 0; i < n_nodes; i++)
+        if (offsets[i] > offsets[i + 1])
+            return false;
+    for (eid_t e = 0; e < n_edges; e++)
+        if (neighbors[e] >= n_nodes)
+            return false;
+    if (orig_ids != NULL)
+    {
+        for (uint i = 0; i < n_nodes; i++)
+            if (orig_ids[i] >= n_nodes || node_ids[orig_ids[i]] != i)
+                return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Counter based random number generator: the `counter`-th number of the stream
+ *        `stream`, which does not depend on the numbers drawn before or by other streams
+ */
+inline uint64_t counter_rand(uint64_t seed, uint64_t stream, uint64_t counter)
+{
+    /* splitmix64 finalizer over a key derived from the seed and the stream */
+    auto mix = [](uint64_t z)
+    {
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    };
+    return mix(mix(seed ^ mix(stream + 0x9e3779b97f4a7c15ULL)) + counter * 0x9e3779b97f4a7c15ULL);
+}
+
+/**
+ * @brief Parallel generator of the same kind of graphs of `Graph::generate_graph`: each edge
+ *        i -> j with j > i is present with probability percent / 100 and the values are in
+ *        [1, max_value]. Every node draws from its own random stream, so the graph depends
+ *        only on the seed and not on the number of workers. The gaps between the edges of
+ *        a node are drawn from the geometric distribution, so the cost is proportional to
+ *        the number of edges and not to n_nodes^2 (on dense graphs, where the two are close,
+ *        each candidate is drawn instead). The CSR is built with two passes over
+ *        the streams: the first counts the degrees, the second fills the neighbors.
+ *
+ * @return CSRGraph* the generated graph
+ */
+CSRGraph *CSRGraph::generate_graph_parallel(uint n_nodes, int seed, short max_value, int percent, int n_workers)
+{
+    const uint rows_per_block = 1024; /* the first nodes have more edges, rows are taken in blocks */
+    const int dense_percent = 20;     /* from here on the edges are drawn one candidate at a time */
+    const double p = percent / 100.0;
+    const double log_q = log(1.0 - p);
+
+    /* calls f(j, edge) for the candidates j of the node i in increasing order, edge tells
+       whether i -> j is in the graph (the dense case calls f on every candidate, branch free) */
+    auto for_each_edge = [&](uint i, auto f)
+    {
+        if (p <= 0)
+            return;
+
+        /* the stream of the node, a splitmix64 sequence seeded by the counter based generator */
+        uint64_t state = counter_rand(seed, i, 1);
+        auto next = [&state]()
+        {
+            uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            return z ^ (z >> 31);
+        };
+
+        /* on dense graphs a draw per candidate is cheaper than a logarithm per edge */
+        if (p >= dense_percent / 100.0)
+        {
+            if (p >= 1)
+            {
+                for (uint64_t j = i + 1; j < n_nodes; j++)
+                    f((uint)j, true);
+                return;
+            }
+
+            uint64_t threshold = (uint64_t)(p * 0x1.0p64);
+            for (uint64_t j = i + 1; j < n_nodes; j++)
+            {
+                bool edge = next() < threshold;
+                f((uint)j, edge);
+            }
+            return;
+        }
+
+        for (uint64_t j = i + 1; j < n_nodes; j++)
+        {
+            /* u in (0, 1], the number of skipped candidates is geometric */
+            double u = ((next() >> 11) + 1) * 0x1.0p-53;
+            double skip = floor(log(u) / log_q);
+            if (skip >= (double)(n_nodes - j))
+                break;
+            j += (uint64_t)skip;
+            f((uint)j, true);
+        }
+    };
+
+    /* runs f(i) on every node, the blocks of rows taken dynamically by the workers */
+    auto parallel_rows = [&](auto f)
+    {
+        atomic<uint> next_block(0);
+        auto worker = [&]()
+        {
+            uint first;
+            while ((first = next_block.fetch_add(rows_per_block)) < n_nodes)
+            {
+                uint last = min(n_nodes, first + rows_per_block);
+                for (uint i = first; i < last; i++)
+                    f(i);
+            }
+        };
+
+        vector<thread> threads;
+        for (int t = 1; t < n_workers; t++)
+            threads.emplace_back(worker);
+        worker();
+        for (auto &t : threads)
+            t.join();
+    };
+
+    vector<eid_t> degrees(n_nodes);
+    parallel_rows([&](uint i)
+                  {
+                      eid_t degree = 0;
+                      for_each_edge(i, [&](uint, bool edge) { degree += edge; });
+                      degrees[i] = degree; });
+
+    eid_t n_edges = 0;
+    for (uint i = 0; i < n_nodes; i++)
+        n_edges += degrees[i];
+
+    CSRGraph *g = new CSRGraph(n_nodes, n_edges);
+    g->offsets[0] = 0;
+    for (uint i = 0; i < n_nodes; i++)
+        g->offsets[i + 1] = g->offsets[i] + degrees[i];
+
+    parallel_rows([&](uint i)
+                  {
+                      eid_t pos = g->offsets[i];
+                      uint *neighbors = g->neighbors;
+                      for_each_edge(i, [&](uint j, bool edge)
+                                    {
+                                        if (edge)
+                                            neighbors[pos++] = j; });
+                      g->values[i] = (counter_rand(seed, i, 0) % max_value) + 1; });
+
+    return g;
+}
+
+bool Graph::save_to_file(Graph *g, string filename)
+{
+    CSRGraph csr(g);
+    return CSRGraph::save_to_file(&csr, filename);
+}
+
+/**
+ * @brief Loads a binary graph file into the node based representation
+ *
+ * @return Graph* the graph, NULL if the file is not valid
+ */
+Graph *Graph::load_from_file(string filename)
+{
+    CSRGraph *csr = CSRGraph::map_file(filename);
+    if (csr == NULL)
+        return NULL;
+
+    Graph *g = new Graph(csr->n_nodes);
+    for (uint i = 0; i < csr->n_nodes; i++)
+    {
+        auto adj = csr->get_adj(i);
+        g->nodes[i]->adj.assign(adj.begin(), adj.end());
+        g->set_value(i, csr->get_value(i));
+    }
+
+    delete csr;
+    return g;
+}
+
+void CSRGraph::print_dot()
+{
+    printf("digraph {\n");
+    for (uint i = 0; i < n_nodes; i++)
+    {
+        for (auto &curr : this->get_adj(i))
+            printf("  %d -> %d;\n", i, curr);
+    }
+    printf("}\n");
+}
+
+/**
+ * @brief Builds the reverse graph of `g` (u -> v becomes v -> u) as CSR, i.e. the
+ *        incoming adjacencies of every node, with the same node values
+ *
+ * @tparam G the graph representation (`Graph` or `CSRGraph`)
+ * @return CSRGraph* the transposed graph, the in-lists are sorted by source node
+ */
+template <typename G>
+CSRGraph *transpose_graph(const G *g)
+{
+    eid_t n_edges = 0;
+    for (uint i = 0; i < g->n_nodes; i++)
+        n_edges += g->get_degree(i);
+
+    CSRGraph *rg = new CSRGraph(g->n_nodes, n_edges);
+
+    /* counting the in-degrees, then turning them into the starting offsets */
+    memset(rg->offsets, 0, ((size_t)g->n_nodes + 1) * sizeof(eid_t));
+    for (uint i = 0; i < g->n_nodes; i++)
+        for (auto &val : g->get_adj(i))
+            rg->offsets[val + 1]++;
+    for (uint i = 0; i < g->n_nodes; i++)
+        rg->offsets[i + 1] += rg->offsets[i];
+
+    vector<eid_t> pos(rg->offsets, rg->offsets + g->n_nodes);
+    for (uint i = 0; i < g->n_nodes; i++)
+    {
+        rg->values[i] = g->get_value(i);
+        for (auto &val : g->get_adj(i))
+            rg->neighbors[pos[val]++] = i;
+    }
+
+    return rg;
+}
+
+/**
+ * @brief Builds the undirected version of `g` as CSR: u -> v and v -> u for every edge
+ *        of `g`, without duplicates, with the same node values and original ids
+ *
+ * @tparam G the graph representation (`Graph` or `CSRGraph`)
+ * @return CSRGraph* the symmetric graph, the adjacencies are sorted
+ */
+template <typename G>
+CSRGraph *symmetrize_graph(const G *g)
+{
+    CSRGraph *rg = transpose_graph(g);
+
+    /* the sorted union of the outgoing and the incoming adjacencies of every node */
+    vector<vector<uint>> adj(g->n_nodes);
+    eid_t n_edges = 0;
+    for (uint i = 0; i < g->n_nodes; i++)
+    {
+        vector<uint> out(g->get_adj(i).begin(), g->get_adj(i).end());
+        sort(out.begin(), out.end());
+        set_union(out.begin(), out.end(), rg->get_adj(i).begin(), rg->get_adj(i).end(), back_inserter(adj[i]));
+        adj[i].erase(unique(adj[i].begin(), adj[i].end()), adj[i].end());
+        n_edges += adj[i].size();
+    }
+    delete rg;
+
+    bool relabeled = false;
+    for (uint i = 0; i < g->n_nodes && !relabeled; i++)
+        relabeled = (g->orig_id(i) != i);
+
+    CSRGraph *s = new CSRGraph(g->n_nodes, n_edges);
+    if (relabeled)
+    {
+        s->orig_ids = new uint[g->n_nodes];
+        s->node_ids = new uint[g->n_nodes];
+    }
+
+    eid_t pos = 0;
+    for (uint i = 0; i < g->n_nodes; i++)
+    {
+        s->offsets[i] = pos;
+        s->values[i] = g->get_value(i);
+        if (relabeled)
+        {
+            s->orig_ids[i] = g->orig_id(i);
+            s->node_ids[s->orig_ids[i]] = i;
+        }
+        copy(adj[i].begin(), adj[i].end(), s->neighbors + pos);
+        pos += adj[i].size();
+    }
+    s->offsets[g->n_nodes] = pos;
+
+    return s;
+}
+
 #endif
\ No newline at end of file
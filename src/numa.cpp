@@ -0,0 +1,231 @@
+/**
+ * @file numa.cpp
+ * @author Marco Costa
+ * @brief NUMA topology, thread pinning and first-touch placement of the graph by NUMA node
+ * @version 0.1
+ * @date 2021-09-08
+ */
+#ifndef NUMA_CPP
+#define NUMA_CPP
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <algorithm>
+#include <pthread.h>
+#include <sched.h>
+
+#include "graph.cpp"
+
+/**
+ * @brief Parses a kernel cpu list such as `0-3,8-11`
+ */
+vector<int> parseCpuList(const string &list)
+{
+    vector<int> cpus;
+    stringstream ss(list);
+    string range;
+    while (getline(ss, range, ','))
+    {
+        if (range.empty() || range == "\n")
+            continue;
+        size_t dash = range.find('-');
+        int first = atoi(range.substr(0, dash).c_str());
+        int last = (dash == string::npos) ? first : atoi(range.substr(dash + 1).c_str());
+        for (int c = first; c <= last; c++)
+            cpus.push_back(c);
+    }
+    return cpus;
+}
+
+/**
+ * @brief The cpus of each NUMA node, as exposed in /sys/devices/system/node.
+ *        Without that information (or off linux) the machine is one node with every cpu.
+ */
+class NumaTopology
+{
+public:
+    vector<vector<int>> node_cpus;
+
+    static NumaTopology detect()
+    {
+        NumaTopology t;
+        for (int node = 0;; node++)
+        {
+            ifstream f("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+            if (!f.is_open())
+                break;
+            string list;
+            getline(f, list);
+            vector<int> cpus = parseCpuList(list);
+            if (!cpus.empty()) /* memory-only nodes have no cpu to run the workers */
+                t.node_cpus.push_back(cpus);
+        }
+
+        if (t.node_cpus.empty())
+        {
+            t.node_cpus.push_back({});
+            int n_cpus = max(1, (int)std::thread::hardware_concurrency());
+            for (int c = 0; c < n_cpus; c++)
+                t.node_cpus[0].push_back(c);
+        }
+        return t;
+    }
+
+    int n_nodes() const { return node_cpus.size(); }
+};
+
+/**
+ * @brief How `n_workers` workers and the nodes of a graph are split among the NUMA nodes in use
+ *        (the sockets, at most one per worker). The workers are assigned to the sockets in blocks,
+ *        each socket owns a contiguous range of graph nodes proportional to its workers, and each
+ *        worker first touches its own part of the range of its socket. The ranges are multiples of
+ *        64 nodes, so no word of a bitmap over the nodes is shared between two workers.
+ */
+class NumaLayout
+{
+public:
+    int n_workers;
+    int n_sockets;
+    vector<int> socket_of_worker;
+    vector<int> rank_in_socket;
+    vector<int> workers_in_socket;
+    vector<uint> socket_first; /* socket s owns the nodes [socket_first[s], socket_first[s + 1]) */
+
+    NumaLayout(const NumaTopology &topology, int n_workers, uint n_nodes) : n_workers(n_workers),
+                                                                            n_sockets(min(topology.n_nodes(), n_workers)),
+                                                                            socket_of_worker(n_workers),
+                                                                            rank_in_socket(n_workers),
+                                                                            workers_in_socket(n_sockets),
+                                                                            socket_first(n_sockets + 1),
+                                                                            topology(topology),
+                                                                            n_nodes(n_nodes)
+    {
+        for (int w = 0; w < n_workers; w++)
+        {
+            int s = (int)((long)w * n_sockets / n_workers);
+            socket_of_worker[w] = s;
+            rank_in_socket[w] = workers_in_socket[s]++;
+        }
+
+        int before = 0;
+        for (int s = 0; s < n_sockets; s++)
+        {
+            socket_first[s] = split(before, n_workers);
+            before += workers_in_socket[s];
+        }
+        socket_first[n_sockets] = n_nodes;
+    }
+
+    /**
+     * @brief The socket owning the node v
+     */
+    inline int owner(uint v) const
+    {
+        int s = 0;
+        while (v >= socket_first[s + 1])
+            s++;
+        return s;
+    }
+
+    /**
+     * @brief The nodes [*first, *last) first touched by the worker `thread_no`
+     */
+    void worker_range(int thread_no, uint *first, uint *last) const
+    {
+        /* the workers before `thread_no` are the ones of the previous sockets and ranks */
+        int before = 0;
+        for (int s = 0; s < socket_of_worker[thread_no]; s++)
+            before += workers_in_socket[s];
+        before += rank_in_socket[thread_no];
+
+        *first = split(before, n_workers);
+        *last = split(before + 1, n_workers);
+    }
+
+    /**
+     * @brief Pins the calling thread, the worker `thread_no`, to one cpu of its socket
+     *        or, when `per_core` is false, to all the cpus of its socket
+     *
+     * @return bool whether the affinity could be set
+     */
+    bool pin(int thread_no, bool per_core) const
+    {
+        const vector<int> &cpus = topology.node_cpus[socket_of_worker[thread_no]];
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (per_core)
+            CPU_SET(cpus[rank_in_socket[thread_no] % cpus.size()], &set);
+        else
+            for (auto &c : cpus)
+                CPU_SET(c, &set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+    }
+
+private:
+    NumaTopology topology;
+    uint n_nodes;
+
+    /* the first node of the `i`-th of `n` equal parts, rounded to 64 nodes */
+    uint split(int i, int n) const
+    {
+        if (i >= n)
+            return n_nodes;
+        uint first = (uint)(((uint64_t)n_nodes * i / n) & ~(uint64_t)63);
+        return min(first, n_nodes);
+    }
+};
+
+/**
+ * @brief Copies `g` into a CSRGraph placed on the NUMA nodes of `layout`: every worker,
+ *        pinned on its socket, writes first the offsets, the values and the adjacencies
+ *        of its range of nodes, so the kernel allocates their pages on that socket.
+ *
+ * @tparam G the graph representation (`Graph` or `CSRGraph`)
+ * @param g the graph to copy
+ * @param layout the NUMA layout of the workers which will search the graph
+ * @return CSRGraph* the placed copy
+ */
+template <typename G>
+CSRGraph *numa_place(const G *g, const NumaLayout &layout)
+{
+    /* prefix sum of the degrees, written in the placed offsets only by the workers */
+    vector<eid_t> offsets(g->n_nodes + 1);
+    for (uint i = 0; i < g->n_nodes; i++)
+        offsets[i + 1] = offsets[i] + g->get_degree(i);
+
+    CSRGraph *placed = new CSRGraph(g->n_nodes, offsets[g->n_nodes]);
+
+    auto f = [&](int thread_no)
+    {
+        layout.pin(thread_no, false);
+
+        uint first, last;
+        layout.worker_range(thread_no, &first, &last);
+        for (uint i = first; i < last; i++)
+        {
+            placed->offsets[i] = offsets[i];
+            placed->values[i] = g->get_value(i);
+            eid_t pos = offsets[i];
+            for (auto &val : g->get_adj(i))
+                placed->neighbors[pos++] = val;
+        }
+        if (last == g->n_nodes)
+            placed->offsets[g->n_nodes] = offsets[g->n_nodes];
+    };
+
+    vector<thread *> thread_ids(layout.n_workers);
+    for (int i = 0; i < layout.n_workers; i++)
+        thread_ids[i] = new thread(f, i);
+    for (int i = 0; i < layout.n_workers; i++)
+    {
+        thread_ids[i]->join();
+        delete thread_ids[i];
+    }
+
+    return placed;
+}
+
+#endif
@@ -0,0 +1,140 @@
+/**
+ * @file prefetch.cpp
+ * @author Marco Costa
+ * @brief Software prefetch pipeline of the frontier expansion, with a configurable distance
+ * @version 0.1
+ * @date 2021-09-08
+ */
+#ifndef PREFETCH_CPP
+#define PREFETCH_CPP
+
+#include <iterator>
+#include <type_traits>
+#include <algorithm>
+
+#include "graph.cpp"
+#include "compressed_graph.cpp"
+#include "config.hpp"
+
+/*
+ * Expanding a frontier node is a chain of dependent misses: the node record (offsets, value),
+ * then its adjacency, then the visited word of each neighbor. The pipeline issues them for
+ * different nodes at once: at the entry t of the frontier the record of the entry
+ * t + 2 * distance is prefetched, the adjacency of the entry t + distance (whose record
+ * should have arrived) and the visited words of the first neighbors of the entry
+ * t + distance / 2; the neighbors of a node are then tested by blocks, the visited words of
+ * a block prefetched while the previous one is tested.
+ */
+
+/* the frontier entries looked ahead, 0 disables the prefetch; set by `--prefetch` */
+inline size_t prefetch_distance = default_prefetch_distance;
+
+/* the neighbors whose visited words are prefetched at once, about a cache line of neighbors */
+const static size_t prefetch_block = 16;
+
+/* the node record and, once it is in cache, the adjacency of a node, per graph representation */
+inline void prefetch_node(const CSRGraph *g, uint v)
+{
+    __builtin_prefetch(&g->offsets[v]);
+    __builtin_prefetch(&g->values[v]);
+}
+
+inline void prefetch_adj(const CSRGraph *g, uint v) { __builtin_prefetch(g->neighbors + g->offsets[v]); }
+
+inline void prefetch_node(const Graph *g, uint v) { __builtin_prefetch(g->nodes[v]); }
+
+inline void prefetch_adj(const Graph *g, uint v) { __builtin_prefetch(g->nodes[v]->adj.data()); }
+
+inline void prefetch_node(const CompressedGraph *g, uint v)
+{
+    __builtin_prefetch(&g->offsets[v]);
+    __builtin_prefetch(&g->values[v]);
+}
+
+inline void prefetch_adj(const CompressedGraph *g, uint v) { __builtin_prefetch(g->bytes + g->offsets[v]); }
+
+/* whether the neighbors of the adjacency `A` can be read ahead, the compressed ones cannot */
+template <typename A>
+constexpr bool random_access_adj()
+{
+    using It = decltype(std::declval<const A &>().begin());
+    return std::is_base_of<std::random_access_iterator_tag, typename std::iterator_traits<It>::iterator_category>::value;
+}
+
+/**
+ * @brief Calls `visit(val)` on the neighbors `adj` of a node, prefetching with `prefetch(val)`
+ *        the visited words of the next `prefetch_block` neighbors while a block is tested.
+ *        The first block is left to the pipeline of `for_each_prefetched`.
+ */
+template <typename A, typename P, typename F>
+inline void for_each_neighbor_prefetched(const A &adj, P prefetch, F visit)
+{
+    if constexpr (random_access_adj<A>())
+    {
+        auto first = adj.begin();
+        size_t n = adj.end() - first;
+        for (size_t b = 0; b < n; b += prefetch_block)
+        {
+            size_t last = std::min(n, b + prefetch_block);
+            for (size_t k = last; k < std::min(n, last + prefetch_block); k++)
+                prefetch(first[k]);
+            for (size_t k = b; k < last; k++)
+                visit(first[k]);
+        }
+    }
+    else
+    {
+        for (auto &val : adj)
+            visit(val);
+    }
+}
+
+/**
+ * @brief Calls `expand(node(t))` on the entries t = 0, ..., n - 1 of a frontier, running the
+ *        prefetch pipeline `prefetch_distance` entries ahead (the plain loop if 0).
+ *        `node(t)` may be called for any t < n, also before the entry is expanded.
+ *
+ * @tparam G the graph representation (`Graph`, `CSRGraph` or `CompressedGraph`)
+ * @tparam N uint(size_t), the node of an entry
+ * @tparam P void(uint), prefetches the visited word of a node
+ * @tparam F void(uint), expands a node
+ */
+template <typename G, typename N, typename P, typename F>
+inline void for_each_prefetched(const G *g, size_t n, N node, P prefetch, F expand)
+{
+    size_t d = prefetch_distance;
+    if (d == 0)
+    {
+        for (size_t t = 0; t < n; t++)
+            expand(node(t));
+        return;
+    }
+
+    size_t h = (d + 1) / 2;
+    for (size_t t = 0; t < std::min(n, 2 * d); t++)
+        prefetch_node(g, node(t));
+    for (size_t t = 0; t < std::min(n, d); t++)
+        prefetch_adj(g, node(t));
+
+    for (size_t t = 0; t < n; t++)
+    {
+        if (t + 2 * d < n)
+            prefetch_node(g, node(t + 2 * d));
+        if (t + d < n)
+            prefetch_adj(g, node(t + d));
+        if constexpr (random_access_adj<typename std::decay<decltype(g->get_adj(0))>::type>())
+        {
+            if (t + h < n)
+            {
+                const auto &adj = g->get_adj(node(t + h));
+                auto first = adj.begin();
+                size_t k_last = std::min<size_t>(adj.end() - first, prefetch_block);
+                for (size_t k = 0; k < k_last; k++)
+                    prefetch(first[k]);
+            }
+        }
+        expand(node(t));
+    }
+}
+
+#endif
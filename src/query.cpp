@@ -0,0 +1,86 @@
+/**
+ * @file query.cpp
+ * @author Marco Costa
+ * @brief The bounded searches: existence, k nearest matches and maximum depth
+ * @version 0.1
+ * @date 2021-09-08
+ */
+#ifndef QUERY_CPP
+#define QUERY_CPP
+
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+#include "utils.cpp"
+
+/**
+ * @brief What a search has to find before it can stop. The default query counts the matches
+ *        of the whole reachable component. With `max_matches` the search stops once that many
+ *        matches are found and reports at most `max_matches` of them: 1 is an existence query,
+ *        k the k nearest matches (the parallel engines stop at the end of the level, a BFS
+ *        level holds matches at the same distance). With `max_depth` the nodes farther than
+ *        `max_depth` hops from the start are not visited.
+ */
+struct BfsQuery
+{
+    int max_matches = -1; /* -1 for no limit */
+    int max_depth = -1;   /* -1 for no limit */
+
+    inline bool bounded() const { return max_matches >= 0 || max_depth >= 0; }
+
+    /* whether the search is over with `matches` found after the level `depth` (0 is the start) */
+    inline bool done(int matches, int depth) const
+    {
+        return (max_matches >= 0 && matches >= max_matches) || (max_depth >= 0 && depth >= max_depth);
+    }
+
+    /* whether the nodes of the level `depth` are expanded, i.e. their adjacencies are in reach */
+    inline bool expands(int depth) const { return max_depth < 0 || depth < max_depth; }
+
+    inline int result(int matches) const { return (max_matches >= 0) ? std::min(matches, max_matches) : matches; }
+};
+
+/**
+ * @brief The query from the command line: `--exists`, `--top k` and `--depth d`, the first
+ *        two are exclusive
+ *
+ * @return bool false if the query is not valid
+ */
+bool setup_query(int argc, char *argv[], BfsQuery *query)
+{
+    *query = BfsQuery();
+    bool exists = cmdOptionExists(argv, argv + argc, "--exists");
+    if (exists && cmdOptionExists(argv, argv + argc, "--top"))
+    {
+        printf("--exists and --top are exclusive\n");
+        return false;
+    }
+    if (exists)
+        query->max_matches = 1;
+
+    if (cmdOptionExists(argv, argv + argc, "--top"))
+    {
+        const char *k = getCmdOption(argv, argv + argc, "--top");
+        query->max_matches = (k != NULL) ? atoi(k) : -1;
+        if (query->max_matches < 1)
+        {
+            printf("--top needs a number of matches >= 1\n");
+            return false;
+        }
+    }
+
+    if (cmdOptionExists(argv, argv + argc, "--depth"))
+    {
+        const char *d = getCmdOption(argv, argv + argc, "--depth");
+        query->max_depth = (d != NULL) ? atoi(d) : -1;
+        if (query->max_depth < 0)
+        {
+            printf("--depth needs a number of hops >= 0\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif
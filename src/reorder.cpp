@@ -0,0 +1,168 @@
+/**
+ * @file reorder.cpp
+ * @author Marco Costa
+ * @brief Relabeling of the graph nodes (reverse Cuthill-McKee, degree or BFS order) for locality
+ * @version 0.1
+ * @date 2021-09-08
+ */
+#ifndef REORDER_CPP
+#define REORDER_CPP
+
+#include <vector>
+#include <string>
+#include <numeric>
+#include <algorithm>
+
+#include "graph.cpp"
+
+/*
+ * An order is the list of the nodes in their new numbering: order[new_id] = old_id.
+ */
+
+/**
+ * @brief The nodes by decreasing degree, the hubs first and close together
+ */
+template <typename G>
+vector<uint> degree_order(const G *g)
+{
+    vector<uint> order(g->n_nodes);
+    iota(order.begin(), order.end(), 0);
+    stable_sort(order.begin(), order.end(), [&](uint a, uint b)
+                { return g->get_degree(a) > g->get_degree(b); });
+    return order;
+}
+
+/**
+ * @brief Appends to `order` the nodes reached from `root` in BFS order, the adjacencies
+ *        of each node visited as they are or, with `by_degree`, by increasing degree
+ */
+template <typename G>
+void append_bfs_order(const G *g, uint root, bool by_degree, vector<char> &visited, vector<uint> &order)
+{
+    vector<uint> next;
+    size_t head = order.size();
+    visited[root] = 1;
+    order.push_back(root);
+    for (; head < order.size(); head++)
+    {
+        next.clear();
+        for (auto &val : g->get_adj(order[head]))
+        {
+            if (!visited[val])
+            {
+                visited[val] = 1;
+                next.push_back(val);
+            }
+        }
+        if (by_degree)
+            stable_sort(next.begin(), next.end(), [&](uint a, uint b)
+                        { return g->get_degree(a) < g->get_degree(b); });
+        order.insert(order.end(), next.begin(), next.end());
+    }
+}
+
+/**
+ * @brief The nodes in BFS order from `root`, then the ones not reached from it in BFS order
+ *        from the first of them, and so on
+ */
+template <typename G>
+vector<uint> bfs_order(const G *g, uint root)
+{
+    vector<char> visited(g->n_nodes);
+    vector<uint> order;
+    order.reserve(g->n_nodes);
+    append_bfs_order(g, root, false, visited, order);
+    for (uint i = 0; i < g->n_nodes; i++)
+        if (!visited[i])
+            append_bfs_order(g, i, false, visited, order);
+    return order;
+}
+
+/**
+ * @brief Reverse Cuthill-McKee order: a BFS visiting the adjacencies by increasing degree,
+ *        started from the lowest degree node of each part of the graph, then reversed.
+ *        It narrows the bandwidth, i.e. the adjacencies of a node get ids close to its own.
+ *        On a directed graph the out adjacencies are followed.
+ */
+template <typename G>
+vector<uint> rcm_order(const G *g)
+{
+    vector<uint> roots(g->n_nodes);
+    iota(roots.begin(), roots.end(), 0);
+    stable_sort(roots.begin(), roots.end(), [&](uint a, uint b)
+                { return g->get_degree(a) < g->get_degree(b); });
+
+    vector<char> visited(g->n_nodes);
+    vector<uint> order;
+    order.reserve(g->n_nodes);
+    for (auto &root : roots)
+        if (!visited[root])
+            append_bfs_order(g, root, true, visited, order);
+
+    reverse(order.begin(), order.end());
+    return order;
+}
+
+/**
+ * @brief Copies `g` into a CSRGraph relabeled by `order`. The adjacencies are sorted by
+ *        new id and the permutation from and to the original ids is kept in the graph,
+ *        composed with the one of `g` when it is relabeled already.
+ *
+ * @tparam G the graph representation (`Graph` or `CSRGraph`)
+ * @param g the graph to relabel
+ * @param order the old id of each new id
+ * @return CSRGraph* the relabeled graph
+ */
+template <typename G>
+CSRGraph *reorder_graph(const G *g, const vector<uint> &order)
+{
+    uint n_nodes = g->n_nodes;
+    eid_t n_edges = 0;
+    for (uint i = 0; i < n_nodes; i++)
+        n_edges += g->get_degree(i);
+
+    vector<uint> rank(n_nodes); /* the new id of each old id */
+    for (uint i = 0; i < n_nodes; i++)
+        rank[order[i]] = i;
+
+    CSRGraph *r = new CSRGraph(n_nodes, n_edges);
+    r->orig_ids = new uint[n_nodes];
+    r->node_ids = new uint[n_nodes];
+
+    eid_t pos = 0;
+    for (uint i = 0; i < n_nodes; i++)
+    {
+        uint old_id = order[i];
+        r->offsets[i] = pos;
+        r->values[i] = g->get_value(old_id);
+        r->orig_ids[i] = g->orig_id(old_id);
+        r->node_ids[r->orig_ids[i]] = i;
+
+        eid_t first = pos;
+        for (auto &val : g->get_adj(old_id))
+            r->neighbors[pos++] = rank[val];
+        sort(r->neighbors + first, r->neighbors + pos);
+    }
+    r->offsets[n_nodes] = pos;
+
+    return r;
+}
+
+/**
+ * @brief Relabels `g` with the order `method` ("rcm", "degree" or "bfs" from `root`)
+ *
+ * @return CSRGraph* the relabeled graph, NULL if the method is unknown
+ */
+template <typename G>
+CSRGraph *reorder_graph(const G *g, const string &method, uint root = 0)
+{
+    if (method == "rcm")
+        return reorder_graph(g, rcm_order(g));
+    if (method == "degree")
+        return reorder_graph(g, degree_order(g));
+    if (method == "bfs")
+        return reorder_graph(g, bfs_order(g, root));
+    return NULL;
+}
+
+#endif
@@ -0,0 +1,251 @@
+/**
+ * @file simd.cpp
+ * @author Marco Costa
+ * @brief Vector kernels of the BFS hot path (AVX2, AVX-512 and scalar), chosen at runtime
+ * @version 0.1
+ * @date 2021-09-08
+ */
+#ifndef SIMD_CPP
+#define SIMD_CPP
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_X86
+#endif
+
+/* the gathers of the visited words race on purpose with the claims of the other workers
+   (see `AtomicBitmap::raw_words32`), so their kernels are left out of ThreadSanitizer */
+#define SIMD_NO_TSAN __attribute__((no_sanitize("thread")))
+
+typedef unsigned int uint;
+
+enum simd_level
+{
+    SIMD_SCALAR = 0,
+    SIMD_AVX2 = 1,
+    SIMD_AVX512 = 2
+};
+
+/* the neighbors filtered per kernel call, the output needs `simd_block + simd_slack` entries */
+const static size_t simd_block = 256;
+const static size_t simd_slack = 16;
+
+/**
+ * @brief Counts the nodes of `nodes[0, n)` whose value is `search_value`
+ */
+size_t count_values_scalar(const short *values, uint n_values, const int *nodes, size_t n, short search_value)
+{
+    (void)n_values;
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++)
+        count += (values[nodes[i]] == search_value);
+    return count;
+}
+
+/**
+ * @brief Writes to `out` the neighbors of `nbrs[0, n)` whose bit is clear in the bitmap `words`,
+ *        seen as 32-bit words, and returns how many they are. The order is kept.
+ */
+size_t filter_unvisited_scalar(const uint *nbrs, size_t n, const uint32_t *words, uint *out)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        uint v = nbrs[i];
+        out[count] = v;
+        /* a relaxed load is a plain load, but tells the words may be set concurrently */
+        count += !((__atomic_load_n(&words[v >> 5], __ATOMIC_RELAXED) >> (v & 31)) & 1);
+    }
+    return count;
+}
+
+#ifdef SIMD_X86
+
+/*
+ * The values are gathered as 32-bit lanes at 2-byte scale, so the gather of the last node
+ * would read past the array: that node is left out of the gather mask and counted apart.
+ */
+
+__attribute__((target("avx2"))) size_t count_values_avx2(const short *values, uint n_values, const int *nodes, size_t n,
+                                                          short search_value)
+{
+    const __m256i key = _mm256_set1_epi32((uint16_t)search_value);
+    const __m256i low = _mm256_set1_epi32(0xFFFF);
+    const __m256i last = _mm256_set1_epi32((int)n_values - 1);
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i idx = _mm256_loadu_si256((const __m256i *)(nodes + i));
+        __m256i safe = _mm256_cmpgt_epi32(last, idx);
+        __m256i v = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int *)values, idx, safe, 2);
+        __m256i eq = _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_and_si256(v, low), key), safe);
+        count += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(eq)));
+
+        int unsafe = ~_mm256_movemask_ps(_mm256_castsi256_ps(safe)) & 0xFF;
+        while (unsafe)
+        {
+            count += (values[nodes[i + __builtin_ctz(unsafe)]] == search_value);
+            unsafe &= unsafe - 1;
+        }
+    }
+    return count + count_values_scalar(values, n_values, nodes + i, n - i, search_value);
+}
+
+/* the permutations moving the lanes selected by each 8-bit mask to the front */
+struct compress_lut_avx2
+{
+    uint32_t perm[256][8];
+
+    compress_lut_avx2()
+    {
+        for (int m = 0; m < 256; m++)
+        {
+            int k = 0;
+            for (int l = 0; l < 8; l++)
+                if (m & (1 << l))
+                    perm[m][k++] = l;
+            for (; k < 8; k++)
+                perm[m][k] = 0;
+        }
+    }
+};
+
+static const compress_lut_avx2 compress_lut;
+
+SIMD_NO_TSAN __attribute__((target("avx2"))) size_t filter_unvisited_avx2(const uint *nbrs, size_t n, const uint32_t *words, uint *out)
+{
+    const __m256i low5 = _mm256_set1_epi32(31);
+    const __m256i one = _mm256_set1_epi32(1);
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(nbrs + i));
+        __m256i w = _mm256_i32gather_epi32((const int *)words, _mm256_srli_epi32(v, 5), 4);
+        __m256i bit = _mm256_and_si256(_mm256_srlv_epi32(w, _mm256_and_si256(v, low5)), one);
+        int mask = ~_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(bit, one))) & 0xFF;
+
+        /* the whole vector is stored, the lanes past the selected ones are overwritten later */
+        __m256i perm = _mm256_loadu_si256((const __m256i *)compress_lut.perm[mask]);
+        _mm256_storeu_si256((__m256i *)(out + count), _mm256_permutevar8x32_epi32(v, perm));
+        count += __builtin_popcount(mask);
+    }
+    return count + filter_unvisited_scalar(nbrs + i, n - i, words, out + count);
+}
+
+__attribute__((target("avx512f"))) size_t count_values_avx512(const short *values, uint n_values, const int *nodes,
+                                                               size_t n, short search_value)
+{
+    const __m512i key = _mm512_set1_epi32((uint16_t)search_value);
+    const __m512i low = _mm512_set1_epi32(0xFFFF);
+    const __m512i last = _mm512_set1_epi32((int)n_values - 1);
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m512i idx = _mm512_loadu_si512((const void *)(nodes + i));
+        __mmask16 safe = _mm512_cmplt_epi32_mask(idx, last);
+        __m512i v = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), safe, idx, (const void *)values, 2);
+        __mmask16 eq = _mm512_mask_cmpeq_epi32_mask(safe, _mm512_and_si512(v, low), key);
+        count += __builtin_popcount(eq);
+
+        unsigned unsafe = (unsigned)(~safe) & 0xFFFF;
+        while (unsafe)
+        {
+            count += (values[nodes[i + __builtin_ctz(unsafe)]] == search_value);
+            unsafe &= unsafe - 1;
+        }
+    }
+    return count + count_values_scalar(values, n_values, nodes + i, n - i, search_value);
+}
+
+SIMD_NO_TSAN __attribute__((target("avx512f"))) size_t filter_unvisited_avx512(const uint *nbrs, size_t n,
+                                                                                const uint32_t *words, uint *out)
+{
+    const __m512i low5 = _mm512_set1_epi32(31);
+    const __m512i one = _mm512_set1_epi32(1);
+    const __mmask16 all = 0xFFFF;
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        /* the zero-masked forms, the plain ones trip -Wmaybe-uninitialized in the gcc headers */
+        __m512i v = _mm512_loadu_si512((const void *)(nbrs + i));
+        __m512i w = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), all, _mm512_maskz_srli_epi32(all, v, 5),
+                                                (const void *)words, 4);
+        __mmask16 visited = _mm512_test_epi32_mask(_mm512_maskz_srlv_epi32(all, w, _mm512_and_si512(v, low5)), one);
+        __mmask16 unvisited = ~visited;
+        _mm512_mask_compressstoreu_epi32((void *)(out + count), unvisited, v);
+        count += __builtin_popcount(unvisited);
+    }
+    return count + filter_unvisited_scalar(nbrs + i, n - i, words, out + count);
+}
+
+#endif
+
+/**
+ * @brief The widest level supported by the cpu
+ */
+simd_level simd_detect()
+{
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return SIMD_AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return SIMD_AVX2;
+#endif
+    return SIMD_SCALAR;
+}
+
+/**
+ * @brief The kernels in use, selected once at startup on the cpu
+ */
+struct simd_kernels
+{
+    simd_level level;
+    size_t (*count_values)(const short *values, uint n_values, const int *nodes, size_t n, short search_value);
+    size_t (*filter_unvisited)(const uint *nbrs, size_t n, const uint32_t *words, uint *out);
+
+    static simd_kernels for_level(simd_level level)
+    {
+#ifdef SIMD_X86
+        if (level == SIMD_AVX512)
+            return {level, count_values_avx512, filter_unvisited_avx512};
+        if (level == SIMD_AVX2)
+            return {level, count_values_avx2, filter_unvisited_avx2};
+#endif
+        return {SIMD_SCALAR, count_values_scalar, filter_unvisited_scalar};
+    }
+};
+
+inline simd_kernels simd = simd_kernels::for_level(simd_detect());
+
+/**
+ * @brief Selects the kernels "scalar", "avx2" or "avx512", never above what the cpu supports
+ *
+ * @return bool false if the level is unknown
+ */
+bool simd_set_level(const std::string &name)
+{
+    simd_level level;
+    if (name == "scalar")
+        level = SIMD_SCALAR;
+    else if (name == "avx2")
+        level = SIMD_AVX2;
+    else if (name == "avx512")
+        level = SIMD_AVX512;
+    else
+        return false;
+
+    simd_level supported = simd_detect();
+    simd = simd_kernels::for_level((level < supported) ? level : supported);
+    return true;
+}
+
+#endif
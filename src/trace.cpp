@@ -0,0 +1,165 @@
+/**
+ * @file trace.cpp
+ * @author Marco Costa
+ * @brief Opt-in per-level instrumentation of the BFS searches, enabled compiling with -DBFS_TRACE
+ * @version 0.1
+ * @date 2021-09-08
+ */
+#ifndef TRACE_CPP
+#define TRACE_CPP
+
+/* the statements in TRACE(...) are compiled only with -DBFS_TRACE, so there is no cost otherwise */
+#ifdef BFS_TRACE
+#define TRACE(...) __VA_ARGS__
+#else
+#define TRACE(...)
+#endif
+
+#ifdef BFS_TRACE
+
+#include <cstdio>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+
+#include "utimer.cpp"
+
+/**
+ * @brief What one worker did in one level
+ */
+struct TraceThreadLevel
+{
+    size_t nodes = 0;    /* frontier entries expanded */
+    size_t edges = 0;    /* adjacencies scanned */
+    double busy_us = 0;  /* time spent expanding */
+    double wait_us = -1; /* time spent on the barrier, including the levels expanded
+                            inline by the master meanwhile, negative when not measured */
+    perf_values perf;    /* hardware counters while expanding, -1 when not measured */
+};
+
+/**
+ * @brief Per-level trace of one search. Each worker writes only its own records and the
+ *        master only the level records, they are read by `print` after the workers are joined.
+ *        Each level is printed as one JSON object per line on stderr:
+ *        `level_us` is the parallel phase seen by the master, `merge_us` the serial phase after it,
+ *        `idle_us` of a worker is the part of the parallel phase it was not expanding,
+ *        a level expanded inline by the master (see `LevelCutoff`) is recorded as worker 0's,
+ *        the hardware counters are those of `perf_counters` around the expansion.
+ */
+class BfsTrace
+{
+public:
+    BfsTrace(const std::string &engine, int n_workers) : engine(engine), threads(n_workers)
+    {
+        search = next_search.fetch_add(1);
+    }
+
+    static double now_us()
+    {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * @brief The record of the worker `thread_no` for the level `level`, to be used only by that worker
+     *        (or by the master on an inline level, while the workers are parked): it may resize
+     *        the records of the worker, so a reference is not kept across a barrier
+     */
+    TraceThreadLevel &at(int thread_no, size_t level)
+    {
+        auto &levels = threads[thread_no].levels;
+        if (levels.size() <= level)
+            levels.resize(level + 1);
+        return levels[level];
+    }
+
+    /**
+     * @brief Records a level, called by the master once the workers have expanded it
+     */
+    void add_level(size_t frontier, double level_us, double merge_us)
+    {
+        levels.push_back({frontier, level_us, merge_us});
+    }
+
+    void print(FILE *out = stderr)
+    {
+        for (size_t l = 0; l < levels.size(); l++)
+        {
+            size_t edges = 0;
+            double max_busy = 0, sum_busy = 0;
+            for (auto &t : threads)
+            {
+                TraceThreadLevel tl = (l < t.levels.size()) ? t.levels[l] : TraceThreadLevel();
+                edges += tl.edges;
+                max_busy = std::max(max_busy, tl.busy_us);
+                sum_busy += tl.busy_us;
+            }
+
+            fprintf(out, "{\"engine\": \"%s\", \"search\": %d, \"level\": %zu, \"frontier\": %zu, \"edges\": %zu, "
+                         "\"level_us\": %.2f, \"merge_us\": %.2f, \"imbalance\": %.3f",
+                    engine.c_str(), search, l, levels[l].frontier, edges, levels[l].level_us, levels[l].merge_us,
+                    (sum_busy > 0) ? max_busy * threads.size() / sum_busy : 1.0);
+            print_field(out, l, "nodes", 0, [](const TraceThreadLevel &tl, double)
+                        { return (double)tl.nodes; });
+            print_field(out, l, "thread_edges", 0, [](const TraceThreadLevel &tl, double)
+                        { return (double)tl.edges; });
+            print_field(out, l, "busy_us", 2, [](const TraceThreadLevel &tl, double)
+                        { return tl.busy_us; });
+            print_field(out, l, "wait_us", 2, [](const TraceThreadLevel &tl, double)
+                        { return tl.wait_us; });
+            print_field(out, l, "idle_us", 2, [](const TraceThreadLevel &tl, double level_us)
+                        { return std::max(level_us - tl.busy_us, 0.0); });
+            print_field(out, l, "cycles", 0, [](const TraceThreadLevel &tl, double)
+                        { return (double)tl.perf.cycles; });
+            print_field(out, l, "instructions", 0, [](const TraceThreadLevel &tl, double)
+                        { return (double)tl.perf.instructions; });
+            print_field(out, l, "llc_misses", 0, [](const TraceThreadLevel &tl, double)
+                        { return (double)tl.perf.llc_misses; });
+            print_field(out, l, "branch_misses", 0, [](const TraceThreadLevel &tl, double)
+                        { return (double)tl.perf.branch_misses; });
+            fprintf(out, "}\n");
+        }
+    }
+
+private:
+    struct Level
+    {
+        size_t frontier;
+        double level_us;
+        double merge_us;
+    };
+
+    /* one cache line apart, each worker grows only its own vector */
+    struct alignas(64) Thread
+    {
+        std::vector<TraceThreadLevel> levels;
+    };
+
+    std::string engine;
+    int search;
+    std::vector<Thread> threads;
+    std::vector<Level> levels;
+
+    static inline std::atomic<int> next_search{0};
+
+    template <typename F>
+    void print_field(FILE *out, size_t l, const char *name, int precision, F field)
+    {
+        fprintf(out, ", \"%s\": [", name);
+        for (size_t i = 0; i < threads.size(); i++)
+        {
+            TraceThreadLevel tl = (l < threads[i].levels.size()) ? threads[i].levels[l] : TraceThreadLevel();
+            double val = field(tl, levels[l].level_us);
+            if (val < 0) /* not measured */
+                fprintf(out, "%snull", (i > 0) ? ", " : "");
+            else
+                fprintf(out, "%s%.*f", (i > 0) ? ", " : "", precision, val);
+        }
+        fprintf(out, "]");
+    }
+};
+
+#endif
+
+#endif
@@ -1,7 +1,7 @@
 /**
  * @file utils.cpp
  * @author Marco Costa
- * @brief Utils for the command line parsing
+ * @brief Utils for the command line parsing and the graph setup shared by the executables
  * @version 0.1
  * @date 2021-09-08
  */
@@ -10,6 +10,14 @@
 
 #include <iostream>
 #include <algorithm>
+#include <vector>
+#include <string>
+#include <cstdlib>
+
+#include "graph.cpp"
+#include "reorder.cpp"
+#include "edge_list.cpp"
+#include "compressed_graph.cpp"
 
 char* getCmdOption(char ** begin, char ** end, const std::string & option)
 {
@@ -25,4 +33,147 @@ bool cmdOptionExists(char** begin, char** end, const std::string& option)
     return std::find(begin, end, option) != end;
 }
 
+/**
+ * @brief Parses a comma separated list of integers, e.g. "0,12,7"
+ */
+std::vector<int> parseIntList(const char *list)
+{
+    std::vector<int> values;
+    std::string s(list);
+    size_t pos = 0;
+    while (pos <= s.size())
+    {
+        size_t next = s.find(',', pos);
+        if (next == std::string::npos)
+            next = s.size();
+        if (next > pos)
+            values.push_back(atoi(s.substr(pos, next - pos).c_str()));
+        pos = next + 1;
+    }
+    return values;
+}
+
+/**
+ * @brief Builds the graph requested on the command line. With `--graph file` the
+ *        binary graph is mapped from the file (always as CSR), with `--edges file` an
+ *        edge list is loaded by `--ingest n_threads` workers (always as CSR, n_nodes 0
+ *        takes the number of nodes from the file), otherwise a graph is generated. `--pgen n_threads` generates it with `CSRGraph::generate_graph_parallel`
+ *        (always as CSR). `--undirected` adds the reverse of every edge (then a CSR).
+ *        `--reorder rcm|degree|bfs` relabels the graph (then a CSR),
+ *        the bfs order starting from `--start`. With `--save file` the generated or
+ *        relabeled graph is also written to disk, so the relabeling is paid once.
+ *
+ * @param g set to the node based graph, NULL if the CSR is used
+ * @param csr set to the CSR graph when `--csr`, `--graph`, `--edges`, `--pgen`, `--undirected` or `--reorder` is given,
+ *            NULL otherwise
+ * @return bool false if the graph could not be loaded, relabeled or saved
+ */
+bool setup_graph(int argc, char *argv[], uint n_nodes, int seed, short max_value, int percent,
+                 Graph **g, CSRGraph **csr)
+{
+    *g = NULL;
+    *csr = NULL;
+
+    bool mapped = cmdOptionExists(argv, argv + argc, "--graph");
+    if (mapped)
+    {
+        char *filename = getCmdOption(argv, argv + argc, "--graph");
+        if (filename == NULL)
+            return false;
+        *csr = CSRGraph::map_file(filename);
+        if (*csr == NULL)
+            return false;
+    }
+    else if (cmdOptionExists(argv, argv + argc, "--edges"))
+    {
+        char *filename = getCmdOption(argv, argv + argc, "--edges");
+        if (filename == NULL)
+            return false;
+        int n_threads = (cmdOptionExists(argv, argv + argc, "--ingest")) ? atoi(getCmdOption(argv, argv + argc, "--ingest"))
+                                                                         : (int)std::thread::hardware_concurrency();
+        *csr = load_edge_list(filename, n_nodes, seed, max_value, n_threads);
+        if (*csr == NULL)
+            return false;
+    }
+    else if (cmdOptionExists(argv, argv + argc, "--pgen"))
+    {
+        /* the parallel generator builds the CSR directly */
+        char *n_threads = getCmdOption(argv, argv + argc, "--pgen");
+        if (n_threads == NULL)
+            return false;
+        *csr = CSRGraph::generate_graph_parallel(n_nodes, seed, max_value, percent, atoi(n_threads));
+    }
+    else
+        *g = Graph::generate_graph(n_nodes, seed, max_value, percent);
+
+    if (cmdOptionExists(argv, argv + argc, "--undirected"))
+    {
+        CSRGraph *s = (*csr != NULL) ? symmetrize_graph(*csr) : symmetrize_graph(*g);
+        delete *g;
+        delete *csr;
+        *g = NULL;
+        *csr = s;
+        mapped = false;
+    }
+
+    if (cmdOptionExists(argv, argv + argc, "--reorder"))
+    {
+        char *method = getCmdOption(argv, argv + argc, "--reorder");
+        uint root = (cmdOptionExists(argv, argv + argc, "--start")) ? atoi(getCmdOption(argv, argv + argc, "--start")) : 0;
+        CSRGraph *r = NULL;
+        if (method != NULL)
+            r = (*csr != NULL) ? reorder_graph(*csr, method, (*csr)->node_id(root)) : reorder_graph(*g, method, root);
+        if (r == NULL)
+        {
+            fprintf(stderr, "Unknown reordering %s\n", (method != NULL) ? method : "");
+            return false;
+        }
+        delete *g;
+        delete *csr;
+        *g = NULL;
+        *csr = r;
+        mapped = false;
+    }
+
+    /* a mapped file is saved only once relabeled, it could be the file itself otherwise */
+    if (!mapped && cmdOptionExists(argv, argv + argc, "--save"))
+    {
+        char *filename = getCmdOption(argv, argv + argc, "--save");
+        if (filename == NULL)
+            return false;
+        if (!((*csr != NULL) ? CSRGraph::save_to_file(*csr, filename) : Graph::save_to_file(*g, filename)))
+            return false;
+    }
+
+    if (*g != NULL && cmdOptionExists(argv, argv + argc, "--csr"))
+    {
+        *csr = new CSRGraph(*g);
+        delete *g;
+        *g = NULL;
+    }
+
+    return true;
+}
+
+/**
+ * @brief With `--compress`, replaces the graph built by `setup_graph` with its
+ *        `CompressedGraph`, encoded by `n_workers` workers, and deletes it
+ *
+ * @return CompressedGraph* the compressed graph, NULL without `--compress`
+ */
+CompressedGraph *setup_compressed(int argc, char *argv[], int n_workers, Graph **g, CSRGraph **csr)
+{
+    if (!cmdOptionExists(argv, argv + argc, "--compress"))
+        return NULL;
+
+    CompressedGraph *cg = (*csr != NULL) ? new CompressedGraph(*csr, n_workers) : new CompressedGraph(*g, n_workers);
+    fprintf(stderr, "Compressed adjacencies: %zu bytes, %.2f bytes per edge\n", cg->adj_bytes(),
+            (double)cg->adj_bytes() / ((cg->n_edges > 0) ? cg->n_edges : 1));
+    delete *g;
+    delete *csr;
+    *g = NULL;
+    *csr = NULL;
+    return cg;
+}
+
 #endif
\ No newline at end of file
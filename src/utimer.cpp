@@ -3,15 +3,23 @@
 
 #include <iostream>
 #include <chrono>
+#include <cstdint>
+#include <cstring>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
 
 
-#define START(timename) auto timename = std::chrono::system_clock::now();
-#define STOP(timename,elapsed)  auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now() - timename).count();
+#define START(timename) auto timename = std::chrono::steady_clock::now();
+#define STOP(timename,elapsed)  auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - timename).count();
 
 
 class utimer {
-  std::chrono::system_clock::time_point start;
-  std::chrono::system_clock::time_point stop;
+  std::chrono::steady_clock::time_point start;
+  std::chrono::steady_clock::time_point stop;
   std::string message; 
   using usecs = std::chrono::microseconds;
   using msecs = std::chrono::milliseconds;
@@ -22,16 +30,16 @@ private:
 public:
 
   utimer(const std::string m) : message(m),us_elapsed((long *)NULL) {
-    start = std::chrono::system_clock::now();
+    start = std::chrono::steady_clock::now();
   }
     
   utimer(const std::string m, long * us) : message(m),us_elapsed(us) {
-    start = std::chrono::system_clock::now();
+    start = std::chrono::steady_clock::now();
   }
 
   ~utimer() {
     stop =
-      std::chrono::system_clock::now();
+      std::chrono::steady_clock::now();
     std::chrono::duration<double> elapsed =
       stop - start;
     auto musec =
@@ -44,4 +52,159 @@ public:
   }
 };
 
+
+/* the hardware counters read by `perf_counters`, -1 when a counter is not available */
+struct perf_values {
+  int64_t cycles = -1;
+  int64_t instructions = -1;
+  int64_t llc_misses = -1;
+  int64_t branch_misses = -1;
+
+  perf_values operator-(const perf_values &o) const {
+    perf_values d;
+    d.cycles = diff(cycles, o.cycles);
+    d.instructions = diff(instructions, o.instructions);
+    d.llc_misses = diff(llc_misses, o.llc_misses);
+    d.branch_misses = diff(branch_misses, o.branch_misses);
+    return d;
+  }
+
+  perf_values &operator+=(const perf_values &o) {
+    cycles = sum(cycles, o.cycles);
+    instructions = sum(instructions, o.instructions);
+    llc_misses = sum(llc_misses, o.llc_misses);
+    branch_misses = sum(branch_misses, o.branch_misses);
+    return *this;
+  }
+
+private:
+  static int64_t diff(int64_t a, int64_t b) { return (a < 0 || b < 0) ? -1 : a - b; }
+  static int64_t sum(int64_t a, int64_t b) { return (a < 0 || b < 0) ? -1 : a + b; }
+};
+
+
+/*
+ * perf_event counters of the calling thread, user space only. They are opened by the
+ * constructor and counting until the destructor, so a region is measured as the difference
+ * of two `read`. With `inherit` the threads created afterwards by this thread are counted too.
+ * Where perf_event_open is not permitted (or not on linux) the counters read as -1.
+ */
+class perf_counters {
+  static const int n_events = 4;
+  int fds[n_events];
+
+public:
+
+  perf_counters(bool inherit = false) {
+#ifdef __linux__
+    const uint64_t configs[n_events] = {
+      PERF_COUNT_HW_CPU_CYCLES,
+      PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_CACHE_MISSES,
+      PERF_COUNT_HW_BRANCH_MISSES
+    };
+    for(int i = 0; i < n_events; i++) {
+      struct perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = configs[i];
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.inherit = inherit ? 1 : 0;
+      /* the events are not grouped, a multiplexed counter is scaled on its running time */
+      attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+#else
+    (void)inherit;
+    for(int i = 0; i < n_events; i++)
+      fds[i] = -1;
+#endif
+  }
+
+  ~perf_counters() {
+#ifdef __linux__
+    for(int i = 0; i < n_events; i++)
+      if(fds[i] >= 0)
+        close(fds[i]);
+#endif
+  }
+
+  perf_counters(const perf_counters &) = delete;
+  perf_counters &operator=(const perf_counters &) = delete;
+
+  bool available() const {
+    for(int i = 0; i < n_events; i++)
+      if(fds[i] >= 0)
+        return true;
+    return false;
+  }
+
+  perf_values read() const {
+    perf_values v;
+    int64_t *out[n_events] = {&v.cycles, &v.instructions, &v.llc_misses, &v.branch_misses};
+#ifdef __linux__
+    for(int i = 0; i < n_events; i++) {
+      uint64_t buf[3]; /* value, time enabled, time running */
+      if(fds[i] < 0 || ::read(fds[i], buf, sizeof(buf)) != sizeof(buf))
+        continue;
+      *out[i] = (buf[2] == 0) ? 0 : (int64_t)((double)buf[0] * buf[1] / buf[2]);
+    }
+#else
+    (void)out;
+#endif
+    return v;
+  }
+};
+
+
+/*
+ * profiling variant of utimer: besides the steady_clock time it reports the hardware
+ * counters of the scoped region, counting the threads the region creates
+ */
+class ptimer {
+  std::chrono::steady_clock::time_point start;
+  std::string message;
+  perf_counters counters;
+  perf_values start_values;
+
+private:
+  long * us_elapsed;
+  perf_values * values;
+
+public:
+
+  ptimer(const std::string m, long * us = (long *)NULL, perf_values * v = (perf_values *)NULL)
+    : message(m), counters(true), us_elapsed(us), values(v) {
+    start_values = counters.read();
+    start = std::chrono::steady_clock::now();
+  }
+
+  ~ptimer() {
+    auto stop = std::chrono::steady_clock::now();
+    perf_values d = counters.read() - start_values;
+    auto musec =
+      std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count();
+
+    std::cout << message << " computed in " << musec << " usec";
+    if(d.cycles >= 0)
+      std::cout << ", " << d.cycles << " cycles";
+    if(d.instructions >= 0)
+      std::cout << ", " << d.instructions << " instructions";
+    if(d.cycles > 0 && d.instructions >= 0)
+      std::cout << " (IPC " << (double)d.instructions / d.cycles << ")";
+    if(d.llc_misses >= 0)
+      std::cout << ", " << d.llc_misses << " LLC misses";
+    if(d.branch_misses >= 0)
+      std::cout << ", " << d.branch_misses << " branch misses";
+    std::cout << std::endl;
+
+    if(us_elapsed != NULL)
+      (*us_elapsed) = musec;
+    if(values != NULL)
+      (*values) = d;
+  }
+};
+
 #endif
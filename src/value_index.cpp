@@ -0,0 +1,298 @@
+/**
+ * @file value_index.cpp
+ * @author Marco Costa
+ * @brief The value index: the occurrences of every value reachable from a node, answered without a search
+ * @version 0.1
+ * @date 2021-09-08
+ */
+#ifndef VALUE_INDEX_CPP
+#define VALUE_INDEX_CPP
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <queue>
+#include <algorithm>
+#include <unordered_map>
+
+#include "graph.cpp"
+
+/**
+ * @brief Precomputed answers of the BFS search, the number of nodes reachable from a start
+ *        node with a given value. On a symmetric (undirected) graph the nodes reachable from
+ *        a node are its connected component: the components are labeled with a parallel
+ *        union-find and each one keeps the histogram of its values, so a search is a lookup.
+ *        On a directed graph the reachable sets overlap and are not summarized by the
+ *        components: the first search from a node stores the histogram of the values it
+ *        reaches, the next ones from the same node are a lookup.
+ *        The graph is changed through `set_value` and `add_edge` of the index (on a `Graph`),
+ *        which update the index or invalidate it; an invalid index is rebuilt by the next `count`.
+ *
+ * @tparam G the graph representation (`Graph` or `CSRGraph`)
+ */
+template <typename G>
+class ValueIndex
+{
+public:
+    ValueIndex(G *g, int n_workers) : g(g), n_workers(n_workers)
+    {
+        build();
+        undirected = symmetric;
+    }
+
+    ValueIndex(const ValueIndex &) = delete;
+    ValueIndex &operator=(const ValueIndex &) = delete;
+
+    /**
+     * @brief The occurrences of `search_value` reachable from `start_node`, as `sequential_bfs`
+     */
+    int count(uint start_node, int search_value)
+    {
+        if (!valid)
+            build();
+        if (search_value < min_value || search_value > max_value)
+            return 0;
+
+        size_t v = search_value - min_value;
+        if (symmetric)
+            return hist[row[find(start_node)] * n_values + v];
+
+        auto it = memo.find(start_node);
+        if (it == memo.end())
+            it = memo.emplace(start_node, reached_values(start_node)).first;
+        return it->second[v];
+    }
+
+    /**
+     * @brief Sets the value of a node of the graph, the histogram of its component is
+     *        updated. The stored histograms of a directed graph are dropped, since the
+     *        starts reaching the node are not known.
+     */
+    void set_value(uint node_i, short value)
+    {
+        short old_value = g->get_value(node_i);
+        g->set_value(node_i, value);
+        if (!valid)
+            return;
+
+        if (value < min_value || value > max_value)
+            valid = false; /* no column for the value, rebuilt on the next count */
+        else if (symmetric)
+        {
+            size_t r = row[find(node_i)] * n_values;
+            hist[r + (old_value - min_value)]--;
+            hist[r + (value - min_value)]++;
+        }
+        else
+            memo.clear();
+    }
+
+    /**
+     * @brief Adds an edge to the graph. On a graph symmetric when the index was built the
+     *        edge is added in both directions, keeping the graph undirected also while the
+     *        index is invalid, and the two components are joined.
+     */
+    void add_edge(uint n1, uint n2)
+    {
+        g->add_edge(n1, n2);
+        if (undirected && n1 != n2)
+            g->add_edge(n2, n1);
+        if (!valid)
+            return;
+
+        if (symmetric)
+            join(n1, n2);
+        else
+            memo.clear();
+    }
+
+    /* whether the graph is symmetric, so the searches are answered by component */
+    inline bool by_component() const { return symmetric; }
+    inline uint n_components() const { return n_comps; }
+
+private:
+    G *g;
+    int n_workers;
+    bool valid = false;
+    bool symmetric = false;  /* of the graph at the last build */
+    bool undirected = false; /* of the graph at the construction, kept by `add_edge` */
+    short min_value = 0, max_value = -1;
+    size_t n_values = 0;
+
+    std::unique_ptr<std::atomic<uint>[]> parent; /* the union-find forest of the components */
+    std::vector<uint> row;                       /* the histogram row of each root */
+    std::vector<int> hist;                       /* n_values counts per row */
+    uint n_comps = 0;
+
+    std::unordered_map<uint, std::vector<int>> memo; /* the histogram reached from each start, directed graphs */
+
+    /* runs f(first, last) on `n_workers` equal ranges of the nodes */
+    template <typename F>
+    void for_ranges(F f) const
+    {
+        std::vector<std::thread *> thread_ids(n_workers);
+        for (int i = 0; i < n_workers; i++)
+            thread_ids[i] = new std::thread(f, (uint)((uint64_t)g->n_nodes * i / n_workers),
+                                            (uint)((uint64_t)g->n_nodes * (i + 1) / n_workers));
+        for (auto &t : thread_ids)
+        {
+            t->join();
+            delete t;
+        }
+    }
+
+    void build()
+    {
+        memo.clear();
+        min_value = 0;
+        max_value = -1;
+        if (g->n_nodes > 0)
+        {
+            min_value = max_value = g->get_value(0);
+            for (uint i = 1; i < g->n_nodes; i++)
+            {
+                min_value = std::min(min_value, g->get_value(i));
+                max_value = std::max(max_value, g->get_value(i));
+            }
+        }
+        n_values = max_value - min_value + 1;
+
+        symmetric = is_symmetric();
+        if (symmetric)
+            build_components();
+        valid = true;
+    }
+
+    bool is_symmetric() const
+    {
+        CSRGraph *rg = transpose_graph(g);
+        std::atomic<bool> same{true};
+        for_ranges([&](uint first, uint last)
+                   {
+            std::vector<uint> adj;
+            for (uint i = first; i < last && same.load(std::memory_order_relaxed); i++)
+            {
+                if (g->get_degree(i) != rg->get_degree(i))
+                {
+                    same = false;
+                    return;
+                }
+                /* the incoming adjacencies are sorted by construction */
+                adj.assign(g->get_adj(i).begin(), g->get_adj(i).end());
+                std::sort(adj.begin(), adj.end());
+                if (!std::equal(adj.begin(), adj.end(), rg->get_adj(i).begin()))
+                    same = false;
+            } });
+        delete rg;
+        return same;
+    }
+
+    /* the root of x, halving the path; only the roots change by a link, x is never one here */
+    inline uint find(uint x) const
+    {
+        uint p = parent[x].load(std::memory_order_relaxed);
+        while (p != x)
+        {
+            uint gp = parent[p].load(std::memory_order_relaxed);
+            parent[x].store(gp, std::memory_order_relaxed);
+            x = gp;
+            p = parent[x].load(std::memory_order_relaxed);
+        }
+        return x;
+    }
+
+    /* links the roots of a and b, the larger one under the smaller, safe among the workers */
+    void unite(uint a, uint b) const
+    {
+        while (true)
+        {
+            a = find(a);
+            b = find(b);
+            if (a == b)
+                return;
+            if (a < b)
+                std::swap(a, b);
+            uint expected = a;
+            if (parent[a].compare_exchange_strong(expected, b, std::memory_order_relaxed))
+                return;
+        }
+    }
+
+    void build_components()
+    {
+        parent.reset(new std::atomic<uint>[g->n_nodes]);
+        for_ranges([&](uint first, uint last)
+                   {
+            for (uint i = first; i < last; i++)
+                parent[i].store(i, std::memory_order_relaxed); });
+
+        /* each undirected edge once, from its lower end */
+        for_ranges([&](uint first, uint last)
+                   {
+            for (uint i = first; i < last; i++)
+                for (auto &val : g->get_adj(i))
+                    if (i < val)
+                        unite(i, val); });
+
+        for_ranges([&](uint first, uint last)
+                   {
+            for (uint i = first; i < last; i++)
+                parent[i].store(find(i), std::memory_order_relaxed); });
+
+        row.assign(g->n_nodes, 0);
+        n_comps = 0;
+        for (uint i = 0; i < g->n_nodes; i++)
+            if (parent[i].load(std::memory_order_relaxed) == i)
+                row[i] = n_comps++;
+
+        hist.assign((size_t)n_comps * n_values, 0);
+        for_ranges([&](uint first, uint last)
+                   {
+            for (uint i = first; i < last; i++)
+                __atomic_fetch_add(&hist[row[parent[i].load(std::memory_order_relaxed)] * n_values + (g->get_value(i) - min_value)],
+                                   1, __ATOMIC_RELAXED); });
+    }
+
+    /* joins the components of a and b after the build, merging their histograms */
+    void join(uint a, uint b)
+    {
+        a = find(a);
+        b = find(b);
+        if (a == b)
+            return;
+        if (a < b)
+            std::swap(a, b);
+        parent[a].store(b, std::memory_order_relaxed);
+        for (size_t v = 0; v < n_values; v++)
+            hist[row[b] * n_values + v] += hist[row[a] * n_values + v];
+        n_comps--;
+    }
+
+    /* the histogram of the values reachable from `start_node`, a sequential BFS */
+    std::vector<int> reached_values(uint start_node) const
+    {
+        std::vector<int> h(n_values);
+        std::vector<bool> visited(g->n_nodes);
+        std::queue<uint> q;
+        q.push(start_node);
+        visited[start_node] = true;
+        while (!q.empty())
+        {
+            uint curr = q.front();
+            q.pop();
+            h[g->get_value(curr) - min_value]++;
+            for (auto &val : g->get_adj(curr))
+            {
+                if (!visited[val])
+                {
+                    visited[val] = true;
+                    q.push(val);
+                }
+            }
+        }
+        return h;
+    }
+};
+
+#endif
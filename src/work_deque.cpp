@@ -0,0 +1,144 @@
+/**
+ * @file work_deque.cpp
+ * @author Marco Costa
+ * @brief Lock-free Chase-Lev work-stealing deque of nodes
+ * @version 0.1
+ * @date 2021-09-08
+ */
+#ifndef WORK_DEQUE_CPP
+#define WORK_DEQUE_CPP
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "config.hpp"
+
+/**
+ * @brief Chase-Lev deque (with the memory orders of Le et al., "Correct and efficient
+ *        work-stealing for weak memory models"): the owner pushes and pops at the bottom
+ *        without any atomic read-modify-write but for the last element, the thieves steal
+ *        from the top with a compare-and-swap. The circular array doubles when full; the
+ *        old arrays may still be read by a thief and are freed with the deque.
+ */
+class alignas(64) ChaseLevDeque
+{
+public:
+    explicit ChaseLevDeque(size_t log_size = default_deque_log_size) : top(0), bottom(0)
+    {
+        array.store(new Array(log_size), std::memory_order_relaxed);
+    }
+
+    ~ChaseLevDeque()
+    {
+        delete array.load(std::memory_order_relaxed);
+        for (auto &a : retired)
+            delete a;
+    }
+
+    ChaseLevDeque(const ChaseLevDeque &) = delete;
+    ChaseLevDeque &operator=(const ChaseLevDeque &) = delete;
+
+    /**
+     * @brief Pushes `x` at the bottom, called by the owner only
+     */
+    inline void push(uint x)
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        Array *a = array.load(std::memory_order_relaxed);
+        if (b - t > (int64_t)a->mask)
+            a = grow(a, t, b);
+        a->put(b, x);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Pops the bottom element, called by the owner only
+     *
+     * @return bool false if the deque is empty, or its last element was stolen
+     */
+    inline bool pop(uint &x)
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        Array *a = array.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+
+        if (t > b)
+        {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+        x = a->get(b);
+        if (t < b)
+            return true;
+
+        /* the last element, raced with the thieves */
+        bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return won;
+    }
+
+    /**
+     * @brief Steals the top element, called by any other worker
+     *
+     * @return bool false if the deque is empty or the steal lost a race, which is not retried
+     */
+    inline bool steal(uint &x)
+    {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+        if (t >= b)
+            return false;
+
+        Array *a = array.load(std::memory_order_acquire);
+        x = a->get(t);
+        return top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    /* the elements left, exact only when the deque is not used concurrently */
+    inline size_t size() const
+    {
+        int64_t n = bottom.load(std::memory_order_relaxed) - top.load(std::memory_order_relaxed);
+        return (n > 0) ? n : 0;
+    }
+
+private:
+    struct Array
+    {
+        size_t mask;
+        std::atomic<uint> *buf;
+
+        explicit Array(size_t log_size) : mask(((size_t)1 << log_size) - 1), buf(new std::atomic<uint>[mask + 1]) {}
+        ~Array() { delete[] buf; }
+
+        inline uint get(int64_t i) const { return buf[i & mask].load(std::memory_order_relaxed); }
+        inline void put(int64_t i, uint x) { buf[i & mask].store(x, std::memory_order_relaxed); }
+    };
+
+    alignas(64) std::atomic<int64_t> top;
+    alignas(64) std::atomic<int64_t> bottom;
+    std::atomic<Array *> array;
+    std::vector<Array *> retired; /* touched by the owner only */
+
+    /* a twice as large copy of the elements [t, b) */
+    Array *grow(Array *a, int64_t t, int64_t b)
+    {
+        size_t log_size = 0;
+        while (((size_t)1 << log_size) <= a->mask)
+            log_size++;
+        Array *bigger = new Array(log_size + 1);
+        for (int64_t i = t; i < b; i++)
+            bigger->put(i, a->get(i));
+        retired.push_back(a);
+        array.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+};
+
+#endif